@@ -33,6 +33,39 @@
 #include <sstream>   // 用于字符串流操作
 #include <algorithm> // 用于字符串分割
 #include <stdexcept> // 用于捕获异常
+#include <thread>    // 用于非阻塞输入时的等待
+#include <csignal>   // 用于在中断时恢复终端状态
+#include <cstdio>    // 用于格式化计时器
+#include <map>       // 用于按榜单分组的排行榜
+#include <random>    // 用于蒙特卡洛采样
+#include <numeric>   // 用于初始化采样顺序
+#include <cmath>     // 用于计算接受概率和置信区间
+#include <cctype>    // 用于原地解析命令
+#include <climits>   // 用于限制解析出的坐标范围
+#include <cstdint>   // 用于残局库文件中的定长整数
+#include <cstring>   // 用于比较残局库文件头
+#include <atomic>    // 用于多线程生成残局时分配任务
+#include <mutex>     // 用于保护后台补充的棋盘缓存
+#include <condition_variable> // 用于在缓存不足时唤醒后台线程
+#include <unordered_map> // 用于按用户名查找排行榜成绩
+#include <memory>    // 用于管理会话内存池的内存块
+#include <functional> // 用于线程池中的任务
+#include <deque>     // 用于线程池的任务队列
+#include <fcntl.h>   // 用于打开排行榜锁文件
+#include <ext/pb_ds/assoc_container.hpp> // 用于支持按名次查询的平衡树
+#include <ext/pb_ds/tree_policy.hpp>
+
+#ifdef _WIN32
+#include <conio.h>   // 用于无阻塞读取按键
+#include <io.h>      // 用于锁定排行榜文件
+#include <sys/locking.h>
+#else
+#include <termios.h> // 用于切换终端原始模式
+#include <sys/file.h> // 用于锁定排行榜文件
+#include <sys/mman.h> // 用于内存映射残局库文件和棋盘缓存文件
+#include <sys/stat.h> // 用于获取残局库文件大小
+#include <poll.h>    // 用于无阻塞轮询标准输入
+#endif
 
 using namespace std;
 
@@ -41,10 +74,78 @@ const int EASY = 4; // 简单难度
 const int MEDIUM = 8; // 中等难度
 const int HARD = 16; // 困难难度
 
+// 会话内存池：按局分配的棋盘数组都从这里顺序取用，每局（或天梯每层）开始时整体重置。
+// 重置后保留已有容量，只有棋盘比以前都大时才会向系统申请内存
+class SessionArena {
+public:
+	void *allocate(size_t bytes) {
+		bytes = (bytes + 15) / 16 * 16;
+		
+		if (blocks.empty() || used + bytes > blockSizes.back()) {
+			size_t size = max(bytes, blocks.empty() ? (size_t)4096 : blockSizes.back() * 2);
+			blocks.emplace_back(new unsigned char[size]);
+			blockSizes.push_back(size);
+			used = 0;
+		}
+		
+		void *result = blocks.back().get() + used;
+		used += bytes;
+		return result;
+	}
+	
+	// 释放本局分配的全部内存；上一局用到了多个块时合并成一个足够大的块
+	void reset() {
+		if (blocks.size() > 1) {
+			size_t total = 0;
+			
+			for (size_t size : blockSizes) {
+				total += size;
+			}
+			
+			blocks.clear();
+			blockSizes.clear();
+			blocks.emplace_back(new unsigned char[total]);
+			blockSizes.push_back(total);
+		}
+		
+		used = 0;
+	}
+	
+private:
+	vector<unique_ptr<unsigned char[]>> blocks;
+	vector<size_t> blockSizes;
+	size_t used = 0; // 最后一个块中已使用的字节数
+};
+
+SessionArena sessionArena;
+
+// 从会话内存池分配的二维数组，按行连续存储，用法与 vector<vector<T>> 相同：grid[i][j]
+template <typename T>
+class Grid {
+public:
+	void assign(int rowCount, int colCount, T value) {
+		cells = (T *)sessionArena.allocate(sizeof(T) * rowCount * colCount);
+		width = colCount;
+		fill(cells, cells + rowCount * colCount, value);
+	}
+	
+	T *operator[](int i) {
+		return cells + i * width;
+	}
+	
+	const T *operator[](int i) const {
+		return cells + i * width;
+	}
+	
+private:
+	T *cells = nullptr;
+	int width = 0;
+};
+
 int rows, cols, mines; // 行数、列数、地雷数
-vector<vector<char>> board; // 游戏棋盘
-vector<vector<bool>> revealed; // 记录哪些格子已经被揭开
-vector<vector<bool>> flagged; // 记录哪些格子被标记为地雷
+Grid<char> board; // 游戏棋盘
+Grid<bool> revealed; // 记录哪些格子已经被揭开
+Grid<bool> flagged; // 记录哪些格子被标记为地雷
 string username; // 用户名
 string gameMode; // 游戏模式
 string gameDifficulty; // 游戏难度
@@ -52,6 +153,7 @@ int currentLevel = 1; // 当前天梯层数
 int score = 0; // 玩家积分
 bool hasRevive = false; // 是否拥有复活甲
 int revealedCount = 0; // 已揭开的非地雷格子数量
+int flagCount = 0; // 当前被标记的格子数量
 
 // ANSI 转义码
 const string RESET = "\033[0m";
@@ -59,23 +161,43 @@ const string RED = "\033[31m";
 const string GREEN = "\033[32m";
 const string BRIGHT_BLUE = "\033[94m"; // 亮蓝色
 const string YELLOW = "\033[33m"; // 黄色，用于高亮显示
+const string REVERSE = "\033[7m"; // 反色，用于显示光标所在格子
+const string CLEAR_LINE = "\033[K"; // 清除光标到行尾的内容
+const string HIDE_CURSOR = "\033[?25l"; // 隐藏终端光标
+const string SHOW_CURSOR = "\033[?25h"; // 显示终端光标
+
+// 方向键等特殊按键的编码
+const int KEY_NONE = -1; // 轮询超时，没有按键
+const int KEY_UP = 1000;
+const int KEY_DOWN = 1001;
+const int KEY_LEFT = 1002;
+const int KEY_RIGHT = 1003;
+const int TIMER_REFRESH_MS = 33; // 计时器刷新间隔（毫秒）
 
 // 函数声明
+struct CommandReader;
 void initializeGame();
 void startOptionsInterface();
 void printBoard();
+void printCell(int i, int j, int cellWidth, bool highlight);
+void appendPadded(const char *text, int width);
+void appendPadded(int value, int width);
 void placeMines();
+void setupBoard();
 void calculateNumbers();
 void reveal(int x, int y);
 void leftClick(int x, int y);
 void rightClick(int x, int y);
 bool checkWin();
+bool isGameWon();
 void clearScreen();
 void login();
 void logout();
 void showMenu();
-void saveGameRecord(int rows, int cols, int mines, int duration, bool win, int level);
+void saveGameRecord(int rows, int cols, int mines, double duration, bool win, int level);
+double gameSeconds();
 void showHistory();
+void showLeaderboard();
 void handleInvalidInput();
 void ladderMode();
 void saveScore();
@@ -84,6 +206,59 @@ void useItem();
 void mineScanner();
 void revive();
 void classicAndResidualMode();
+bool undoActive();
+void beginMove();
+void recordMove(char action);
+void undoMove();
+void redoMove();
+void markDirty(int x, int y);
+void enableRawMode();
+void disableRawMode();
+int readKey(int timeoutMs);
+void moveCursorTo(int row, int col);
+void drawCell(int i, int j);
+void drawStatusLine();
+void drawFullScreen(bool allowItem);
+char waitForAction(int &x, int &y, bool allowItem);
+bool inputPending();
+void showCommandPrompt(bool allowItem);
+bool runCommandBatch(CommandReader &in, bool allowItem, int depth);
+string leaderboardKey();
+void loadLeaderboard();
+bool validUserName(const string &name);
+void updateLeaderboard(const string &key, const string &user, long long value, bool keepBest);
+bool hintActive();
+void showProbabilityHint();
+void markRevealed(int x, int y);
+void indexMines();
+void rebuildAnalyzer();
+void analyzerReveal(int cell);
+void refreshHeatmap();
+void probabilityHeatmap();
+void loadResidualPuzzle();
+int generateResidualPool(int argc, char *argv[]);
+bool popCachedBoard();
+bool readBoardFileSize();
+bool loadBoardFile();
+bool exportBoard(const string &path);
+int writeBoardCorpus(int argc, char *argv[]);
+struct LevelCandidate;
+void planLadderCandidates();
+bool takeLadderLevel(int level, LevelCandidate &chosen);
+void loadLadderCandidate(const LevelCandidate &candidate);
+void stopLadderPlanner();
+void startGameClock();
+void markInputReady();
+void beginTimedMove(char action, int x, int y);
+void endTimedMove();
+void flushMoveChunk();
+void saveMoveTimeline(bool win, int level, double duration);
+void showMoveAnalysis();
+int analyzeMoveTimelines(int argc, char *argv[]);
+void applyAction(char action, int x, int y);
+void startBoardCache();
+void stopBoardCache();
+void showBoardCacheStats();
 
 // 计时相关变量
 chrono::steady_clock::time_point startTime;
@@ -92,18 +267,712 @@ chrono::steady_clock::time_point startTime;
 int leftClickCount = 0;
 int rightClickCount = 0;
 
+// 批量命令相关变量
+bool quietMode = false; // 静默模式（--quiet），从不渲染棋盘
+int gameGeneration = 0; // 每局开始时递增，用于判断批量命令执行期间是否已经换局
+const int MAX_SCRIPT_DEPTH = 8; // 命令文件嵌套执行的最大深度
+string commandLine; // 复用的命令行缓冲区，getline 会保留它已有的容量
+const size_t COMMAND_LINE_RESERVE = 4096; // 启动时为命令行预留的字节数，一行多条命令也不必在走子时扩容
+string renderBuffer; // 复用的渲染缓冲区，整屏或局部重绘先写入这里再一次输出
+
+// 原地解析的命令：直接在命令行缓冲区上读取字符和整数，不复制字符串，也不构造字符串流
+struct CommandReader {
+	const char *pos;
+	const char *end;
+	
+	void skipSpace() {
+		while (pos != end && isspace((unsigned char)*pos)) {
+			pos++;
+		}
+	}
+	
+	// 跳过空白后读取一个字符
+	bool readChar(char &c) {
+		skipSpace();
+		
+		if (pos == end) return false;
+		
+		c = *pos++;
+		return true;
+	}
+	
+	// 跳过空白后读取一个十进制整数，可以带正负号
+	bool readInt(int &value) {
+		skipSpace();
+		const char *p = pos;
+		bool negative = p != end && *p == '-';
+		
+		if (p != end && (*p == '-' || *p == '+')) p++;
+		
+		if (p == end || !isdigit((unsigned char)*p)) return false;
+		
+		long long result = 0;
+		
+		while (p != end && isdigit((unsigned char)*p)) {
+			result = min(result * 10 + (*p++ - '0'), (long long)INT_MAX);
+		}
+		
+		value = negative ? -result : result;
+		pos = p;
+		return true;
+	}
+	
+	// 跳过空白后读取一个不含空白的单词（命令文件路径）
+	bool readWord(string &word) {
+		skipSpace();
+		const char *begin = pos;
+		
+		while (pos != end && !isspace((unsigned char)*pos)) {
+			pos++;
+		}
+		
+		word.assign(begin, pos);
+		return !word.empty();
+	}
+};
+
+// 编译时定义 COUNT_ALLOCATIONS 可以统计走子路径上的堆分配次数，退出时输出。
+// 只统计主线程（后台补充棋盘缓存的线程不计入），换局或获胜的那一批命令也不计入
+#ifdef COUNT_ALLOCATIONS
+thread_local long long allocationCount = 0;
+long long moveAllocations = 0; // 走子期间的堆分配次数
+long long measuredBatches = 0; // 统计了多少批命令（或多少次按键操作）
+bool toolBatch = false; // 这批命令用了道具、概率提示、导出或脚本，它们本身要分配内存，不计入统计
+
+void *operator new(size_t size) {
+	allocationCount++;
+	void *pointer = malloc(size ? size : 1);
+	
+	if (!pointer) throw bad_alloc();
+	
+	return pointer;
+}
+
+// 所有 delete 都经由同一个不内联的释放函数：内联后 GCC 会把 operator new 和 free 配对误报 -Wmismatched-new-delete
+__attribute__((noinline)) void releaseAllocation(void *pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete(void *pointer) noexcept {
+	releaseAllocation(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+	releaseAllocation(pointer);
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete[](void *pointer) noexcept {
+	releaseAllocation(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+	releaseAllocation(pointer);
+}
+
+void countMoveAllocations(long long before, int generation) {
+	if (gameGeneration == generation && !isGameWon() && !toolBatch) {
+		moveAllocations += allocationCount - before;
+		measuredBatches++;
+	}
+	
+	toolBatch = false;
+}
+#endif
+
+// 悔棋相关变量：每步只记录它改变的格子，悔棋和重做的开销与该步改变的格子数成正比
+struct MoveDelta {
+	int cellEnd; // 该步改变的格子在 moveCells 中的结束下标，起始下标为上一步的结束下标
+	char action; // 'l' 为揭开，'r' 为切换标记
+};
+
+bool allowUndo = false; // 是否开启悔棋（--undo），仅在经典和残局模式下生效
+const int UNDO_PENALTY_SECONDS = 10; // 每次悔棋加到本局用时上的秒数，计入历史战绩和排行榜
+const int MIN_UNDO_HISTORY = 256; // 悔棋记录容量的下限（步数），小棋盘也能连续悔棋多步
+size_t undoHistory = 0; // 本局悔棋记录的容量：记满后丢弃较早的一半，最多能悔棋这么多步
+vector<MoveDelta> moveLog; // 操作记录，下标 moveLogSize 及之后的是已撤销、可重做的操作
+vector<int> moveCells; // 所有操作改变的格子，以 x * cols + y 存储
+size_t moveLogSize = 0; // 当前生效的操作数量
+int undoCount = 0; // 本局悔棋次数
+
+// 排行榜相关变量：所有用户共享一个排行榜文件，按“模式/难度”分为多个榜单
+// 每个榜单在内存中用支持名次查询的平衡树排序，前 K 名和某个用户的名次都能在对数时间内查到
+typedef __gnu_pbds::tree<pair<long long, string>, __gnu_pbds::null_type, less<pair<long long, string>>,
+        __gnu_pbds::rb_tree_tag, __gnu_pbds::tree_order_statistics_node_update> RankTree;
+
+struct LeaderboardTable {
+	unordered_map<string, long long> values; // 用户名 -> 成绩
+	RankTree ranking; // (排序键, 用户名)，排序键越小名次越靠前
+	bool lowerIsBetter = false; // 用时类榜单越小越好，层数和积分类榜单越大越好
+};
+
+const string LEADERBOARD_FILE = "leaderboard.txt"; // 共享排行榜文件
+const string LEADERBOARD_LOCK_FILE = "leaderboard.lock"; // 多个游戏进程通过锁定该文件互斥更新
+const string LADDER_BOARD = "天梯模式"; // 天梯最高通过层数榜单
+const string SCORE_BOARD = "积分"; // 积分榜单
+const int LEADERBOARD_TOP_K = 10; // 每个榜单显示的名次数量
+map<string, LeaderboardTable> leaderboard; // 榜单名 -> 榜单
+
+// 排行榜文件是只追加的成绩日志，同一榜单同一用户以最后一行为准。每个进程在内存中保留所有榜单，
+// 只读取上次之后追加的行；压缩时文件被整体替换，第一行换上新的标识，其他进程据此从头重新读取
+const string LEADERBOARD_HEADER = "#排行榜"; // 压缩后文件的第一行: #排行榜 标识
+const long long LEADERBOARD_COMPACT_SLACK = 256; // 成绩行超过实际成绩数的两倍再多这么多行时压缩
+string leaderboardFileId; // 当前文件的标识，旧格式文件没有标识行
+streamoff leaderboardOffset = 0; // 已经读取并应用到内存中榜单的位置
+long long leaderboardLines = 0; // 文件中有效成绩行的数量
+bool leaderboardComplete = true; // 从头读取以来每一行都解析成功，只有这时才允许压缩（重写）文件
+bool leaderboardTail = false; // 文件最后一行没有换行符（写入中途被中断），追加前先补上换行
+
+// 蒙特卡洛地雷概率估计相关定义
+// 约束模型：未揭开的格子为变量，每个已揭开的数字格子给出其未知邻居中的地雷数
+struct ConstraintModel {
+	vector<int> cells; // 变量对应的棋盘格子，以 x * cols + y 存储
+	vector<vector<int>> constraintVars; // 每个约束涉及的变量
+	vector<int> constraintNeed; // 每个约束要求的地雷数
+	vector<vector<int>> varConstraints; // 每个变量参与的约束
+	int minesLeft = 0; // 未揭开的格子中剩余的地雷数
+	int interiorCount = 0; // 未作为变量列出、不受任何约束的未揭开格子数
+};
+
+struct CellProbability {
+	double p; // 估计的地雷概率，已揭开的格子为 -1
+	double low; // 95% 置信区间下界
+	double high; // 95% 置信区间上界
+};
+
+// 单个采样线程的统计结果
+struct SamplerResult {
+	vector<long long> mineCounts; // 每个变量在样本中为地雷的次数
+	long long samples = 0; // 样本数
+	vector<double> batchSum; // 每批样本中地雷频率之和
+	vector<double> batchSumSq; // 每批样本中地雷频率的平方和
+	int batches = 0; // 完整的批数
+};
+
+struct ProbabilityEstimate {
+	vector<CellProbability> cells; // 按 x * cols + y 存储
+	long long samples = 0; // 满足全部约束的样本数
+	int threads = 0; // 参与采样的线程数
+	long long elapsedMs = 0; // 实际耗时（毫秒）
+};
+
+const int PROBABILITY_TIME_BUDGET_MS = 200; // 提示时概率估计的时间预算
+const int HINT_PENALTY_SECONDS = 10; // 每次概率提示加到本局用时上的秒数，与悔棋相同计入历史战绩和排行榜
+int hintCount = 0; // 本局给出的概率提示次数
+const double SAMPLER_BETA = 2.0; // 违反约束时的惩罚系数，越大越快收敛到合法配置
+const int SAMPLER_BATCH_SIZE = 64; // 批均值法每批的样本数，用于估计相关样本的误差
+string statusMessage; // 下次渲染棋盘时显示在棋盘下方的提示
+
+// 增量前沿分析器：每揭开一个格子只更新它的邻居，维护前沿（与已揭开数字相邻的
+// 未揭开格子）和仍有未知邻居的数字格子，无需每次从头扫描整个棋盘
+struct FrontierAnalyzer {
+	bool stale = true; // 为真时下次使用前需要从头重建（新开局或悔棋之后）
+	int version = 0; // 可见信息每变化一次递增，用于判断概率热图是否过期
+	vector<int> unknownNeighbours; // 每个格子未揭开的邻居数
+	vector<int> numberNeighbours; // 每个格子已揭开的非地雷邻居数
+	vector<int> mineNeighbours; // 每个格子已揭开的地雷邻居数
+	vector<int> frontier; // 前沿格子
+	vector<int> frontierIndex; // 格子在 frontier 中的下标，不在前沿时为 -1
+	vector<int> numbers; // 仍有未揭开邻居的已揭开数字格子
+	vector<int> numberIndex; // 格子在 numbers 中的下标，不在其中时为 -1
+	vector<int> varOf; // 计算概率时前沿格子对应的变量下标，平时全为 -1
+	int unknownCount = 0; // 未揭开的格子总数
+	int revealedMines = 0; // 已揭开的地雷数
+};
+
+FrontierAnalyzer analyzer;
+vector<int> hiddenMines; // 尚未揭开的地雷位置（x * cols + y），供地雷扫描仪直接抽取
+vector<int> hiddenMineIndex; // 格子在 hiddenMines 中的下标，不是未揭开的地雷时为 -1
+bool heatmapActive = false; // 本层是否已使用概率热图道具
+vector<double> heatmap; // 每个格子的地雷概率，已揭开的格子为 -1
+int heatmapVersion = -1; // 热图对应的分析器版本
+const long long EXACT_NODE_LIMIT = 2000000; // 精确枚举的搜索节点上限，超过后改用蒙特卡洛估计
+const int HEATMAP_TIME_BUDGET_MS = 100; // 蒙特卡洛估计热图的时间预算
+const long long PUZZLE_NODE_LIMIT = 20000; // 生成残局时每次精确推理的节点上限，超过就当作推不出来
+
+// 残局相关定义：残局由真实棋盘和一组揭开的格子组成，保证只靠逻辑推理就能揭开其余所有安全格子
+struct PuzzleBoard {
+	int rows = 0, cols = 0, mines = 0;
+	vector<char> cells; // 每个格子的内容（'0'~'8' 或 'M'），以 x * cols + y 存储
+	vector<char> revealed; // 残局开始时已揭开的格子
+};
+
+// 残局库文件：文件头 + 按（行, 列, 地雷, 难度）排序的索引表 + 每个残局的地雷位图和揭开位图
+struct ResidualPoolHeader {
+	char magic[8]; // 固定为 RESIDUAL_POOL_MAGIC
+	uint32_t count; // 残局数量
+	uint32_t version; // 文件格式版本
+};
+
+struct ResidualPoolEntry {
+	uint16_t rows, cols, mines;
+	uint8_t difficulty;
+	uint8_t reserved;
+	uint32_t seed; // 生成棋盘使用的随机种子
+	uint32_t offset; // 位图在文件中的偏移
+};
+
+// 只读内存映射文件，不支持 mmap 的平台上整体读入内存
+class MappedFile {
+public:
+	bool open(const string &path) {
+#ifdef _WIN32
+		ifstream file(path, ios::binary);
+		
+		if (!file.is_open()) return false;
+		
+		buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+		bytes = (const unsigned char *)buffer.data();
+		length = buffer.size();
+		return true;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		
+		if (fd < 0) return false;
+		
+		struct stat info;
+		
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		
+		void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		
+		if (mapped == MAP_FAILED) return false;
+		
+		bytes = (const unsigned char *)mapped;
+		length = info.st_size;
+		return true;
+#endif
+	}
+	
+	~MappedFile() {
+#ifndef _WIN32
+		if (bytes) {
+			munmap((void *)bytes, length);
+		}
+#endif
+	}
+	
+	const unsigned char *data() const {
+		return bytes;
+	}
+	
+	size_t size() const {
+		return length;
+	}
+	
+private:
+	const unsigned char *bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	vector<char> buffer;
+#endif
+};
+
+const string RESIDUAL_POOL_FILE = "residual_pool.bin"; // 预先生成的残局库
+const char RESIDUAL_POOL_MAGIC[8] = {'M', 'S', 'R', 'P', 'O', 'O', 'L', '1'};
+const int RESIDUAL_LEVELS = 3; // 残局难度等级数
+// 各难度隐藏格子的目标比例：难度 1 相对于全部安全格子，难度 2、3 相对于联合推理最多能隐藏的格子
+const double RESIDUAL_HIDE_RATIO[RESIDUAL_LEVELS + 1] = {0, 0.35, 0.9, 1.0};
+const int RESIDUAL_MAX_ATTEMPTS = 64; // 生成一个残局最多尝试的棋盘数，不合格的棋盘用同一个随机数序列换下一块
+int residualDifficulty = 1; // 当前残局难度：1 只需单格推理，2、3 需要联合多个数字推理，3 隐藏的格子严格多于 2
+MappedFile residualPool; // 映射后的残局库，第一次开始残局时打开
+bool residualPoolOpened = false;
+
+// 棋盘缓存相关定义：每种预设棋盘的经典模式和各残局难度各有一个环形队列，保存打包好的棋盘和生成它的种子。
+// 缓存文件映射到内存中，后台线程在队列不足时补充，开局时直接取出队首的棋盘
+struct BoardCacheHeader {
+	char magic[8]; // 固定为 BOARD_CACHE_MAGIC
+	uint32_t ringCount; // 队列数量
+	uint32_t capacity; // 每个队列的槽位数
+};
+
+struct BoardCacheRing {
+	uint16_t rows, cols, mines;
+	uint8_t difficulty; // 0 为经典棋盘，1 ~ RESIDUAL_LEVELS 为残局难度
+	uint8_t reserved;
+	uint32_t slotSize; // 每个槽位的字节数：种子 + 地雷位图 + 揭开位图
+	uint32_t offset; // 第一个槽位在文件中的偏移
+	uint32_t head; // 累计取出的棋盘数，队首槽位为 head % capacity
+	uint32_t tail; // 累计放入的棋盘数
+};
+
+const string BOARD_CACHE_FILE = "board_cache.bin";
+const char BOARD_CACHE_MAGIC[8] = {'M', 'S', 'B', 'C', 'A', 'C', 'H', '1'};
+const uint32_t BOARD_CACHE_CAPACITY = 32; // 每个队列最多缓存的棋盘数
+const uint32_t BOARD_CACHE_LOW_WATER = 8; // 队列中的棋盘少于此数时唤醒后台线程补满
+unsigned char *boardCacheData = nullptr; // 映射的缓存文件，文件不可用时指向 boardCacheMemory
+size_t boardCacheSize = 0;
+bool boardCacheMapped = false; // 是否映射到了缓存文件（否则只缓存在内存中）
+vector<unsigned char> boardCacheMemory;
+mutex boardCacheMutex; // 保护队列的 head/tail 和下面的统计
+condition_variable boardCacheWake;
+thread boardCacheProducer;
+bool boardCacheStopping = false;
+long long boardCacheHits = 0; // 本次运行开局时从缓存取到棋盘的次数
+long long boardCacheMisses = 0; // 预设棋盘开局时缓存为空、只能当场生成的次数
+long long boardCacheProduced = 0; // 后台线程本次运行补充的棋盘数
+double boardCacheProduceMs = 0; // 后台线程生成这些棋盘所用的总时间
+
+// 棋盘交换格式：文件头 BOARD_FILE_MAGIC 之后是任意多条棋盘记录，每条记录为定长的记录头和若干个位平面。
+// 位平面按 x * cols + y 的顺序每格一位，原始编码每字节 8 格（低位在前），
+// RLE 编码为从 0 开始交替的 0/1 游程长度（LEB128 变长整数），游程之和等于格子数，因此记录不需要长度字段
+struct BoardRecordHeader {
+	uint16_t rows, cols;
+	uint32_t mines;
+	uint32_t seed; // 生成棋盘使用的随机种子，未知时为 0
+	uint8_t planes; // 包含的位平面，BOARD_PLANE_* 的组合，地雷平面总是存在
+	uint8_t encoding; // BOARD_ENCODING_RAW 或 BOARD_ENCODING_RLE
+	uint16_t reserved;
+};
+
+const char BOARD_FILE_MAGIC[8] = {'M', 'S', 'B', 'O', 'A', 'R', 'D', '1'};
+const long long MAX_BOARD_CELLS = 1 << 20; // 棋盘文件和语料库允许的最大格子数，游戏中的 rows * cols 按 int 计算
+const uint8_t BOARD_PLANE_MINES = 1;
+const uint8_t BOARD_PLANE_REVEALED = 2;
+const uint8_t BOARD_PLANE_FLAGS = 4;
+const uint8_t BOARD_ENCODING_RAW = 0;
+const uint8_t BOARD_ENCODING_RLE = 1;
+const uint8_t BOARD_ENCODING_AUTO = 255; // 只用于写出：分别估算两种编码的大小，选择较小的一种
+
+// 流式写出一个位平面，逐格调用 put，最后调用 finish。out 为空时只统计字节数
+class PlaneWriter {
+public:
+	PlaneWriter(ostream *out, bool rle) : out(out), rle(rle) {}
+	
+	void put(bool bit) {
+		if (rle) {
+			if (bit != runValue) {
+				emitRun(runLength);
+				runValue = bit;
+				runLength = 0;
+			}
+			
+			runLength++;
+		} else {
+			current |= bit << filled;
+			
+			if (++filled == 8) {
+				emit(current);
+				current = 0;
+				filled = 0;
+			}
+		}
+	}
+	
+	void finish() {
+		if (rle) {
+			if (runLength > 0) {
+				emitRun(runLength);
+			}
+		} else if (filled > 0) {
+			emit(current);
+		}
+	}
+	
+	size_t bytes() const {
+		return written;
+	}
+	
+private:
+	void emit(unsigned char byte) {
+		if (out) out->put(byte);
+		
+		written++;
+	}
+	
+	void emitRun(uint64_t length) {
+		do {
+			unsigned char byte = length & 0x7f;
+			length >>= 7;
+			emit(length ? byte | 0x80 : byte);
+		} while (length);
+	}
+	
+	ostream *out;
+	bool rle;
+	unsigned char current = 0; // 原始编码：尚未写出的字节
+	int filled = 0;
+	bool runValue = false; // RLE 编码：当前游程的值和长度
+	uint64_t runLength = 0;
+	size_t written = 0;
+};
+
+// 流式读取一个位平面，每次 get 只从输入流中读取需要的字节，不把整个文件读入内存
+class PlaneReader {
+public:
+	PlaneReader(istream &in, bool rle) : in(in), rle(rle) {}
+	
+	// 读取下一格，文件被截断或游程超出格子数时返回 false
+	bool get(bool &bit) {
+		if (rle) {
+			// 跳过长度为 0 的游程（只会出现在第一个格子为 1 时）
+			while (runLeft == 0) {
+				if (started) runValue = !runValue;
+				
+				started = true;
+				
+				if (!readRun(runLeft)) return false;
+			}
+			
+			runLeft--;
+			bit = runValue;
+		} else {
+			if (filled == 0) {
+				int byte = in.get();
+				
+				if (byte == EOF) return false;
+				
+				current = byte;
+				filled = 8;
+			}
+			
+			bit = current & 1;
+			current >>= 1;
+			filled--;
+		}
+		
+		return true;
+	}
+	
+	// 整个平面读完后调用：RLE 编码的最后一个游程必须恰好用完
+	bool finish() const {
+		return !rle || runLeft == 0;
+	}
+	
+private:
+	bool readRun(uint64_t &length) {
+		length = 0;
+		
+		for (int shift = 0; shift < 64; shift += 7) {
+			int byte = in.get();
+			
+			if (byte == EOF) return false;
+			
+			length |= (uint64_t)(byte & 0x7f) << shift;
+			
+			if (!(byte & 0x80)) return true;
+		}
+		
+		return false;
+	}
+	
+	istream &in;
+	bool rle;
+	unsigned char current = 0;
+	int filled = 0;
+	bool started = false;
+	bool runValue = false;
+	uint64_t runLeft = 0;
+};
+
+string boardFile; // --board 指定的棋盘文件，开局时代替随机放置地雷
+int boardFileIndex = 0; // --board-index 指定使用文件中的第几条记录（从 0 开始）
+uint32_t boardSeed = 0; // 当前棋盘的随机种子，导出棋盘时写入，未知时为 0
+bool boardFromFile = false; // 当前棋盘从棋盘文件读入，可能已经揭开或标记了格子，成绩不计入排行榜
+
+// 天梯难度评估相关定义：每层开始时在线程池中评估若干候选棋盘，下一层选择预计用时最接近目标难度曲线的棋盘
+struct LevelCandidate {
+	PuzzleBoard puzzle;
+	unsigned seed = 0;
+	int bbbv = 0; // 3BV：不借助 0 自动展开的格子时，揭开所有安全格子至少需要的点击次数
+	int guesses = 0; // 逻辑推理卡住、必须猜测的次数（包括第一次点击）
+	double survival = 1; // 每次都猜地雷概率最小的格子时，全部猜对的概率
+	double expectedSeconds = 0; // 预计通关用时，包括猜错后重新开始的时间
+};
+
+// 固定数量工作线程的线程池，任务按提交顺序执行；停止时丢弃尚未开始的任务
+class ThreadPool {
+public:
+	explicit ThreadPool(int threadCount) {
+		for (int t = 0; t < threadCount; ++t) {
+			workers.emplace_back([this] {
+				run();
+			});
+		}
+	}
+	
+	~ThreadPool() {
+		{
+			lock_guard<mutex> lock(queueMutex);
+			stopping = true;
+		}
+		
+		wake.notify_all();
+		
+		for (auto &worker : workers) {
+			worker.join();
+		}
+	}
+	
+	void submit(function<void()> task) {
+		{
+			lock_guard<mutex> lock(queueMutex);
+			tasks.push_back(move(task));
+		}
+		
+		wake.notify_one();
+	}
+	
+private:
+	void run() {
+		while (true) {
+			function<void()> task;
+			
+			{
+				unique_lock<mutex> lock(queueMutex);
+				wake.wait(lock, [this] {
+					return stopping || !tasks.empty();
+				});
+				
+				if (stopping) return;
+				
+				task = move(tasks.front());
+				tasks.pop_front();
+			}
+			
+			task();
+		}
+	}
+	
+	vector<thread> workers;
+	deque<function<void()>> tasks;
+	mutex queueMutex;
+	condition_variable wake;
+	bool stopping = false;
+};
+
+const int LADDER_CANDIDATES = 12; // 每层评估的候选棋盘数
+const int LADDER_MIN_SIZE = 4; // 候选棋盘的边长范围
+const int LADDER_MAX_SIZE = 24;
+const double LADDER_MIN_DENSITY = 0.10; // 候选棋盘的地雷密度范围
+const double LADDER_MAX_DENSITY = 0.25;
+const double LADDER_BASE_SECONDS = 15; // 目标难度曲线：第 1 层的预计用时
+const double LADDER_GROWTH = 1.3; // 目标难度曲线：每层预计用时的增长倍数
+const double BBBV_PER_SECOND = 1.2; // 估算用时：玩家每秒完成的 3BV
+const double GUESS_SECONDS = 4; // 估算用时：每次猜测前的思考时间
+unique_ptr<ThreadPool> ladderPool; // 第一次进入天梯模式时创建
+mutex ladderPlanMutex; // 保护下面两个变量
+int ladderPlanId = 0; // 每次开始准备新一层的候选时递增，过期的评估结果直接丢弃
+vector<LevelCandidate> ladderCandidates; // 已评估完的下一层候选棋盘
+
+// 走子时间线相关定义：记录每步操作的思考、引擎和渲染耗时，每局结束时追加到 <用户名>_moves.bin。
+// 文件由若干局依次组成，每局为一个文件头加上按列存储的走子数据（依次为操作、行、列、开局后的毫秒数、
+// 思考、引擎、渲染耗时），分析时只需读取用到的列。
+// 一局的步数超过内存中的缓冲区时，写满的部分先作为分块追加到文件，分块与局的格式相同，只是文件头只有步数和开局时间
+const char MOVE_FILE_MAGIC[4] = {'M', 'V', 'T', '1'};
+const char MOVE_CHUNK_MAGIC[4] = {'M', 'V', 'C', '1'};
+
+struct MoveTimelineHeader {
+	char magic[4]; // 固定为 MOVE_FILE_MAGIC
+	uint32_t moves; // 走子步数
+	int64_t startedAt; // 开局时间（Unix 毫秒）
+	uint32_t durationMs; // 整局用时（毫秒）
+	uint32_t bbbv; // 开局时棋盘的 3BV
+	uint16_t rows, cols;
+	uint32_t mines;
+	uint32_t leftClicks, rightClicks; // 有效左键、右键点击次数
+	uint16_t level; // 天梯模式的层数，其他模式为 0
+	uint8_t mode; // 0 经典模式，1 残局模式，2 天梯模式
+	uint8_t win;
+	uint32_t chunkedMoves; // 之前已作为分块写入的步数，这一局本身的各列只包含其余的步数
+};
+
+struct MoveChunkHeader {
+	char magic[4]; // 固定为 MOVE_CHUNK_MAGIC
+	uint32_t moves; // 分块中的步数
+	int64_t startedAt; // 所属对局的开局时间，与对局文件头的 startedAt 相同
+};
+
+struct MoveTiming {
+	char action; // 'l'、'r'、't'、'u'、'y' 或 'p'
+	int16_t x, y; // 操作的格子，没有格子的操作为 -1
+	uint32_t atMs; // 开始执行时距开局的毫秒数
+	float thinkMs; // 从上一步渲染完成、开始等待输入到收到这步操作
+	float engineMs; // 执行这步操作（揭开、标记、推理等）
+	float renderMs; // 这步之后重绘棋盘，直到再次开始等待输入
+};
+
+vector<MoveTiming> moveTimeline; // 当前一局还没有写入文件的走子时间线
+const size_t MOVE_TIMELINE_CHUNK = 4096; // 内存中最多缓存的走子步数，写满后作为一个分块追加到文件
+vector<uint32_t> moveColumnBuffer(MOVE_TIMELINE_CHUNK); // 按列写出时复用的缓冲区，每个字段最多 4 字节
+char moveChunkStreamBuffer[BUFSIZ]; // 写出分块时文件流使用的缓冲区，打开文件时不再分配内存
+uint32_t chunkedMoves = 0; // 当前一局已经作为分块写入文件的步数
+string moveFilePath; // 当前用户的走子时间线文件
+uint32_t gameBBBV = 0; // 当前一局开局时的 3BV
+int64_t gameStartedAt = 0; // 当前一局的开局时间（Unix 毫秒）
+chrono::steady_clock::time_point inputReadyTime, moveStartTime, renderStartTime;
+bool inputReady = false; // 正在等待输入，下一步的思考时间从 inputReadyTime 开始计算
+bool renderPending = false; // 上一步执行完还没有开始等待输入，这段时间算作它的渲染耗时
+bool timedMoveOpen = false; // 正在执行 moveTimeline 最后一步
+const int HISTOGRAM_BUCKETS_PER_DECADE = 50; // 流式分位数直方图的精度：相邻分桶相差约 4.7%
+const double HISTOGRAM_MIN = 1e-3; // 直方图的取值范围，超出范围的值放入两端的分桶
+const int HISTOGRAM_DECADES = 10;
+
+// 事件驱动输入相关变量
+bool interactiveInput = false; // 标准输入是否为终端，是则使用按键事件循环
+bool rawModeActive = false; // 终端当前是否处于原始模式
+bool screenDirty = true; // 屏幕内容是否已被其他输出覆盖，需要整屏重绘
+int cursorX = 0, cursorY = 0; // 光标所在格子
+vector<pair<int, int>> dirtyCells; // 自上次绘制后状态发生变化、需要局部重绘的格子
+#ifndef _WIN32
+struct termios originalTermios; // 进入原始模式前的终端设置
+bool originalTermiosSaved = false;
+#endif
+
 // 初始化游戏
 void initializeGame() {
-	// 初始化棋盘和状态
-	board.assign(rows, vector<char>(cols, '0'));
-	revealed.assign(rows, vector<bool>(cols, false));
-	flagged.assign(rows, vector<bool>(cols, false));
+	// 初始化棋盘和状态，上一局的棋盘内存整体归还给会话内存池
+	sessionArena.reset();
+	board.assign(rows, cols, '0');
+	revealed.assign(rows, cols, false);
+	flagged.assign(rows, cols, false);
 	
 	// 重置点击事件计数器
 	leftClickCount = 0;
 	rightClickCount = 0;
 	hasRevive = false; // 重置复活甲状态
 	revealedCount = 0; // 重置已揭开的非地雷格子数量
+	flagCount = 0; // 重置标记数量
+	
+	// 重置光标和重绘状态
+	cursorX = 0;
+	cursorY = 0;
+	dirtyCells.clear();
+	dirtyCells.reserve(rows * cols);
+	screenDirty = true;
+	gameGeneration++;
+	boardSeed = 0;
+	boardFromFile = false;
+	
+	// 清空悔棋记录并预留全部容量，走子时不再扩容。记录中的操作是一条线性历史，每个格子最多被揭开一次，
+	// 所以 moveCells 不会超过每步一个标记加上整个棋盘
+	moveLog.clear();
+	moveCells.clear();
+	undoHistory = max(rows * cols, MIN_UNDO_HISTORY);
+	moveLog.reserve(undoHistory);
+	moveCells.reserve(undoHistory + rows * cols);
+	moveLogSize = 0;
+	undoCount = 0;
+	hintCount = 0;
+	moveTimeline.clear();
+	moveTimeline.reserve(MOVE_TIMELINE_CHUNK);
+	
+	// 预留整屏渲染需要的空间：每个格子最多包含光标、颜色和复位转义码
+	renderBuffer.reserve(rows * (cols + 1) * 32 + cols * 16 + 256);
+	
+	// 重置地雷索引、分析器和概率热图
+	hiddenMines.clear();
+	hiddenMineIndex.assign(rows * cols, -1);
+	analyzer.stale = true;
+	heatmapActive = false;
+	heatmapVersion = -1;
 }
 
 // 选择游戏模式界面
@@ -147,8 +1016,11 @@ void startOptionsInterface() {
 		break;
 	}
 	
+	// 指定了 --board 时棋盘大小和地雷数来自棋盘文件，不再选择难度
+	bool fromFile = !boardFile.empty() && readBoardFileSize();
+	
 	// 选择游戏难度
-	while (true) {
+	while (!fromFile) {
 		clearScreen();
 		cout << "选择游戏难度:" << endl;
 		cout << "1. 简单 (4x4)" << endl;
@@ -227,61 +1099,123 @@ void startOptionsInterface() {
 		break;
 	}
 	
-	initializeGame(); // 初始化游戏
-	
-	// 初始化残局模式，揭开部分格子
-	if (gameMode == "残局模式") {
-		for (int i = 0; i < rows; ++i) {
-			for (int j = 0; j < cols; ++j) {
-				if (rand() % 2 == 0) {
-					revealed[i][j] = true;
-					if (board[i][j] != 'M') {
-						revealedCount++;
-					}
-				}
-			}
+	// 选择残局难度，残局本身在 setupBoard 中从残局库取出
+	while (gameMode == "残局模式" && !fromFile) {
+		clearScreen();
+		cout << "选择残局难度:" << endl;
+		cout << "1. 简单（只需单个数字即可推理）" << endl;
+		cout << "2. 中等（需要联合多个数字推理）" << endl;
+		cout << "3. 困难（揭开的格子尽可能少）" << endl;
+		cin >> residualDifficulty;
+		
+		if (cin.fail() || residualDifficulty < 1 || residualDifficulty > RESIDUAL_LEVELS) {
+			handleInvalidInput();
+			continue;
 		}
+		
+		break;
 	}
+	
+	initializeGame(); // 初始化游戏
 }
 
-// 打印棋盘
+// 打印棋盘：先写入复用的渲染缓冲区，再一次输出
 void printBoard() {
+	if (quietMode) return; // 静默模式下从不渲染棋盘
+	
+	refreshHeatmap();
 	// 计算最大列数的宽度
 	int maxColWidth = to_string(cols - 1).length();
 	// 计算最大行数的宽度
 	int maxRowWidth = to_string(rows - 1).length();
 	// 计算每个格子的宽度
 	int cellWidth = max(maxColWidth, 2); // 至少为2，以容纳数字和点
+	renderBuffer.clear();
 	
 	// 打印列坐标
-	cout << "   ";
+	renderBuffer += "   ";
 	
 	for (int j = 0; j < cols; ++j) {
-		cout << BRIGHT_BLUE << setw(cellWidth) << j << RESET << " ";
+		renderBuffer += BRIGHT_BLUE;
+		appendPadded(j, cellWidth);
+		renderBuffer += RESET;
+		renderBuffer += ' ';
 	}
 	
-	cout << endl;
+	renderBuffer += '\n';
 	
 	// 打印行坐标和棋盘内容
 	for (int i = 0; i < rows; ++i) {
 		// 打印行坐标
-		cout << GREEN << setw(maxRowWidth) << i << RESET << " ";
+		renderBuffer += GREEN;
+		appendPadded(i, maxRowWidth);
+		renderBuffer += RESET;
+		renderBuffer += ' ';
 		
 		for (int j = 0; j < cols; ++j) {
-			if (revealed[i][j]) {
-				if (board[i][j] == 'M') {
-					cout << RED << setw(cellWidth) << "M" << RESET << " "; // 用红色标记地雷
-				} else {
-					cout << setw(cellWidth) << board[i][j] << " "; // 已揭开的格子
-				}
-			} else if (flagged[i][j]) {
-				cout << setw(cellWidth) << "F" << " "; // 被标记为地雷的格子
-			} else {
-				cout << setw(cellWidth) << "." << " "; // 未揭开的格子
-			}
+			printCell(i, j, cellWidth, rawModeActive && i == cursorX && j == cursorY);
+			renderBuffer += ' ';
 		}
 		
-		cout << endl;
+		renderBuffer += '\n';
+	}
+	
+	cout.write(renderBuffer.data(), renderBuffer.size());
+}
+
+// 向渲染缓冲区追加右对齐到 width 的文本，相当于 setw
+void appendPadded(const char *text, int width) {
+	int length = strlen(text);
+	
+	if (length < width) {
+		renderBuffer.append(width - length, ' ');
+	}
+	
+	renderBuffer += text;
+}
+
+void appendPadded(int value, int width) {
+	char text[16];
+	snprintf(text, sizeof(text), "%d", value);
+	appendPadded(text, width);
+}
+
+// 把单个格子的内容写入渲染缓冲区，highlight 为真时反色显示光标
+void printCell(int i, int j, int cellWidth, bool highlight) {
+	if (highlight) {
+		renderBuffer += REVERSE;
+	}
+	
+	if (revealed[i][j]) {
+		if (board[i][j] == 'M') {
+			// 用红色标记地雷
+			renderBuffer += RED;
+			appendPadded("M", cellWidth);
+			renderBuffer += RESET;
+		} else {
+			char text[2] = {board[i][j], '\0'};
+			appendPadded(text, cellWidth); // 已揭开的格子
+		}
+	} else if (flagged[i][j]) {
+		appendPadded("F", cellWidth); // 被标记为地雷的格子
+	} else if (heatmapActive && heatmapVersion >= 0) {
+		// 概率热图：显示地雷概率的百分数，必为地雷显示 ##
+		int percent = (int)(heatmap[i * cols + j] * 100 + 0.5);
+		renderBuffer += percent == 0 ? GREEN : (percent >= 50 ? RED : YELLOW);
+		
+		if (percent >= 100) {
+			appendPadded("##", cellWidth);
+		} else {
+			appendPadded(percent, cellWidth);
+		}
+		
+		renderBuffer += RESET;
+	} else {
+		appendPadded(".", cellWidth); // 未揭开的格子
+	}
+	
+	if (highlight) {
+		renderBuffer += RESET;
 	}
 }
 
@@ -299,6 +1233,30 @@ void placeMines() {
 			placedMines++;
 		}
 	}
+	
+	indexMines();
+}
+
+// 布置棋盘：指定了 --board 时从棋盘文件读取；预设棋盘优先从棋盘缓存中取出；
+// 否则残局模式从残局库中取出一个可以只靠逻辑推理解开的残局，其他模式随机放置地雷
+void setupBoard() {
+	if (!boardFile.empty()) {
+		if (loadBoardFile()) return;
+		
+		clearScreen();
+		cout << "棋盘文件 " << boardFile << " 已损坏，改为随机放置地雷。" << endl;
+		initializeGame(); // 清除读取到一半的棋盘
+		boardFile.clear();
+	}
+	
+	if (popCachedBoard()) return;
+	
+	if (gameMode == "残局模式") {
+		loadResidualPuzzle();
+	} else {
+		placeMines();
+		calculateNumbers();
+	}
 }
 
 // 计算每个格子周围的地雷数
@@ -329,7 +1287,11 @@ void calculateNumbers() {
 void reveal(int x, int y) {
 	if (x < 0 || x >= rows || y < 0 || y >= cols || revealed[x][y]) return;
 	
-	revealed[x][y] = true;
+	markRevealed(x, y);
+	
+	if (undoActive()) {
+		moveCells.push_back(x * cols + y); // 记录洪水填充揭开的格子
+	}
 	
 	if (board[x][y] != 'M') {
 		revealedCount++;
@@ -357,8 +1319,10 @@ void leftClick(int x, int y) {
 			hasRevive = false; // 使用复活甲
 			clearScreen();
 			cout << YELLOW << "你踩到了地雷，但复活甲救了你！" << RESET << endl;
-			revealed[x][y] = true; // 揭开地雷格子
+			markRevealed(x, y); // 揭开地雷格子
 		} else {
+			endTimedMove(); // 结算画面算作渲染耗时
+			disableRawMode(); // 结算画面用 cin 读取选择
 			clearScreen();
 			cout << YELLOW << "游戏结束！你踩到了地雷。" << RESET << endl;
 			cout << "踩到的地雷位置: (" << x << ", " << y << ")" << endl;
@@ -373,9 +1337,8 @@ void leftClick(int x, int y) {
 			
 			printBoard();
 			// 计算并显示游戏时间
-			auto endTime = chrono::steady_clock::now();
-			auto duration = chrono::duration_cast<chrono::seconds>(endTime - startTime).count();
-			cout << "游戏时间: " << duration << " 秒" << endl;
+			double duration = gameSeconds();
+			cout << "游戏时间: " << fixed << setprecision(3) << duration << " 秒" << defaultfloat << setprecision(6) << endl;
 			// 显示点击事件次数
 			cout << "有效左键点击次数: " << leftClickCount << endl;
 			cout << "有效右键点击次数: " << rightClickCount << endl;
@@ -388,15 +1351,19 @@ void leftClick(int x, int y) {
 				cout << "游戏结束。输入 'm' 返回菜单，或输入 's' 重新开始: ";
 				cin >> choice;
 				
+				if (cin.fail()) {
+					handleInvalidInput();
+					continue;
+				}
+				
 				if (choice == 'm') {
 					showMenu();
 					break;
 				} else if (choice == 's') {
 					clearScreen();
 					startOptionsInterface();
-					placeMines();
-					calculateNumbers();
-					startTime = chrono::steady_clock::now();
+					setupBoard();
+					startGameClock();
 					break;
 				} else {
 					clearScreen();
@@ -405,8 +1372,10 @@ void leftClick(int x, int y) {
 			}
 		}
 	} else {
+		beginMove();
 		reveal(x, y);
 		leftClickCount++; // 增加左键点击计数
+		recordMove('l');
 	}
 }
 
@@ -418,13 +1387,28 @@ void rightClick(int x, int y) {
 		return;
 	}
 	
+	beginMove();
 	flagged[x][y] = !flagged[x][y]; // 切换标记状态
+	flagCount += flagged[x][y] ? 1 : -1;
+	markDirty(x, y);
 	rightClickCount++; // 增加右键点击计数
+	
+	if (undoActive()) {
+		moveCells.push_back(x * cols + y);
+	}
+	
+	recordMove('r');
+}
+
+// 所有非地雷格子是否都已揭开
+bool isGameWon() {
+	return revealedCount + mines == rows * cols;
 }
 
 // 检查游戏是否胜利
 bool checkWin() {
-	if (revealedCount + mines == rows * cols) {
+	if (isGameWon()) {
+		disableRawMode(); // 结算画面用 cin 读取选择
 		clearScreen(); // 清除屏幕
 		cout << YELLOW << "游戏胜利！" << RESET << endl;
 		cout << "正确揭开的格子数: " << revealedCount << endl;
@@ -440,12 +1424,20 @@ bool checkWin() {
 		
 		printBoard();
 		// 计算并显示游戏时间
-		auto endTime = chrono::steady_clock::now();
-		auto duration = chrono::duration_cast<chrono::seconds>(endTime - startTime).count();
-		cout << "游戏时间: " << duration << " 秒" << endl;
+		double duration = gameSeconds();
+		cout << "游戏时间: " << fixed << setprecision(3) << duration << " 秒" << defaultfloat << setprecision(6) << endl;
 		// 显示点击事件次数
 		cout << "有效左键点击次数: " << leftClickCount << endl;
 		cout << "有效右键点击次数: " << rightClickCount << endl;
+		
+		if (undoActive()) {
+			cout << "悔棋次数: " << undoCount << "（用时已加 " << undoCount * UNDO_PENALTY_SECONDS << " 秒）" << endl;
+		}
+		
+		if (hintCount > 0) {
+			cout << "概率提示次数: " << hintCount << "（用时已加 " << hintCount * HINT_PENALTY_SECONDS << " 秒）" << endl;
+		}
+		
 		// 保存游戏记录
 		saveGameRecord(rows, cols, mines, duration, true, currentLevel);
 		return true;
@@ -456,14 +1448,31 @@ bool checkWin() {
 
 // 清除屏幕
 void clearScreen() {
-	system("cls"); // 清除屏幕
+	screenDirty = true; // 棋盘显示被覆盖，下次等待按键时需要整屏重绘
+	
+	if (quietMode) return;
+	
+	cout << "\033[2J\033[H"; // 使用 ANSI 转义码清屏，避免每次渲染都启动外部进程
 }
 
 // 登录
 void login() {
 	clearScreen();
-	cout << "请输入用户名: ";
-	cin >> username;
+	
+	while (true) {
+		cout << "请输入用户名: ";
+		
+		if (!(cin >> username)) {
+			// 输入在登录前就结束了，没有用户需要保存积分，直接退出
+			stopBoardCache();
+			exit(0);
+		}
+		
+		if (validUserName(username)) break;
+		
+		cout << "用户名不能包含空白或控制字符。" << endl;
+	}
+	
 	cout << "欢迎，" << username << "！" << endl;
 	loadScore(); // 加载积分
 }
@@ -473,6 +1482,13 @@ void logout() {
 	clearScreen();
 	cout << "再见，" << username << "！" << endl;
 	saveScore(); // 保存积分
+	stopBoardCache(); // 等待后台线程写完当前棋盘
+	stopLadderPlanner(); // 停止评估天梯候选棋盘
+#ifdef COUNT_ALLOCATIONS
+	cout << "走子期间共处理 " << measuredBatches << " 批操作，堆分配 " << moveAllocations << " 次" << endl;
+	
+	if (moveAllocations > 0) exit(1); // 走子期间分配过内存时以非零状态退出，批量运行可以据此检查
+#endif
 	exit(0);
 }
 
@@ -485,7 +1501,10 @@ void showMenu() {
 		cout << "菜单:" << endl;
 		cout << "1. 开始游戏" << endl;
 		cout << "2. 查看历史战绩" << endl;
-		cout << "3. 登出" << endl;
+		cout << "3. 查看排行榜" << endl;
+		cout << "4. 棋盘缓存统计" << endl;
+		cout << "5. 走子分析" << endl;
+		cout << "6. 登出" << endl;
 		cin >> choice;
 		
 		if (cin.fail()) {
@@ -497,9 +1516,8 @@ void showMenu() {
 		case 1:
 			clearScreen();
 			startOptionsInterface();
-			placeMines();
-			calculateNumbers();
-			startTime = chrono::steady_clock::now();
+			setupBoard();
+			startGameClock();
 			return;
 			
 		case 2:
@@ -508,6 +1526,21 @@ void showMenu() {
 			return;
 			
 		case 3:
+			clearScreen();
+			showLeaderboard();
+			return;
+			
+		case 4:
+			clearScreen();
+			showBoardCacheStats();
+			return;
+			
+		case 5:
+			clearScreen();
+			showMoveAnalysis();
+			return;
+			
+		case 6:
 			logout();
 			return;
 			
@@ -518,14 +1551,19 @@ void showMenu() {
 	}
 }
 
+// 本局用时（秒）：从开局到现在的实际时间，加上悔棋和概率提示的用时惩罚
+double gameSeconds() {
+	return chrono::duration<double>(chrono::steady_clock::now() - startTime).count() + undoCount * UNDO_PENALTY_SECONDS + hintCount * HINT_PENALTY_SECONDS;
+}
+
 // 保存游戏记录
-void saveGameRecord(int rows, int cols, int mines, int duration, bool win, int level) {
+void saveGameRecord(int rows, int cols, int mines, double duration, bool win, int level) {
 	ofstream file(username + "_history.txt", ios::app);
 	
 	if (file.is_open()) {
 		auto now = chrono::system_clock::now();
 		auto now_time_t = chrono::system_clock::to_time_t(now);
-		file << put_time(localtime(&now_time_t), "%Y-%m-%d %H:%M:%S") << " " << gameMode << " ";
+		file << put_time(localtime(&now_time_t), "%Y-%m-%d %H:%M:%S") << " " << gameMode << " " << fixed << setprecision(3);
 		
 		if (gameMode == "经典模式" || gameMode == "残局模式") {
 			file << rows << " " << cols << " " << mines << " " << duration << " " << (win ? "胜利" : "失败") << endl;
@@ -537,6 +1575,18 @@ void saveGameRecord(int rows, int cols, int mines, int duration, bool win, int l
 	} else {
 		cout << "无法保存游戏记录。" << endl;
 	}
+	
+	saveMoveTimeline(win, level, duration);
+	
+	// 胜利时更新共享排行榜：经典和残局模式记录最快用时（毫秒），天梯模式记录最高通过层数。
+	// 从棋盘文件开局的成绩不可比较，不计入排行榜
+	if (win && !boardFromFile) {
+		if (gameMode == "天梯模式") {
+			updateLeaderboard(LADDER_BOARD, username, level, true);
+		} else {
+			updateLeaderboard(leaderboardKey(), username, llround(duration * 1000), true);
+		}
+	}
 }
 
 // 显示历史战绩
@@ -545,7 +1595,7 @@ void showHistory() {
 	
 	if (file.is_open()) {
 		clearScreen();
-		cout << "历史战绩:" << endl;
+		cout << "历史战绩:" << endl << fixed << setprecision(3);
 		string line;
 		
 		while (getline(file, line)) {
@@ -554,12 +1604,14 @@ void showHistory() {
 			iss >> date >> time >> mode;
 			
 			if (mode == "经典模式" || mode == "残局模式") {
-				int rows, cols, mines, duration;
+				int rows, cols, mines;
+				double duration; // 旧记录精确到秒，新记录精确到毫秒
 				string result;
 				iss >> rows >> cols >> mines >> duration >> result;
 				cout << "时间: " << date << " " << time << ", 模式: " << mode << ", 棋盘大小: " << rows << "x" << cols << ", 地雷数量: " << mines << ", 游戏时间: " << duration << " 秒, 结果: " << result << endl;
 			} else if (mode == "天梯模式") {
-				int level, duration;
+				int level;
+				double duration;
 				string result;
 				iss >> level >> duration >> result;
 				cout << "时间: " << date << " " << time << ", 模式: " << mode << ", 通过层数: " << level - 1 << ", 游戏时间: " << duration << " 秒" << endl;
@@ -567,6 +1619,7 @@ void showHistory() {
 		}
 		
 		file.close();
+		cout << defaultfloat << setprecision(6);
 	} else {
 		clearScreen();
 		cout << "没有历史战绩。" << endl;
@@ -578,6 +1631,309 @@ void showHistory() {
 		cout << "输入 'm' 返回菜单: ";
 		cin >> choice;
 		
+		if (cin.fail()) {
+			handleInvalidInput();
+			continue;
+		}
+		
+		if (choice == 'm') {
+			clearScreen();
+			showMenu();
+			break;
+		} else {
+			clearScreen();
+			cout << "无效选择。请重新输入。" << endl;
+		}
+	}
+}
+
+// 排行榜文件锁：构造时加锁，析构时解锁。exclusive 为假时为共享锁，允许多个进程同时读取
+class LeaderboardLock {
+public:
+	explicit LeaderboardLock(bool exclusive) {
+#ifdef _WIN32
+		(void)exclusive; // Windows 下只支持独占锁
+		fd = _open(LEADERBOARD_LOCK_FILE.c_str(), _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+		
+		if (fd >= 0) {
+			_locking(fd, _LK_LOCK, 1);
+		}
+#else
+		fd = open(LEADERBOARD_LOCK_FILE.c_str(), O_RDWR | O_CREAT, 0644);
+		
+		if (fd >= 0) {
+			flock(fd, exclusive ? LOCK_EX : LOCK_SH);
+		}
+#endif
+	}
+	
+	~LeaderboardLock() {
+		if (fd < 0) return;
+		
+#ifdef _WIN32
+		_lseek(fd, 0, SEEK_SET);
+		_locking(fd, _LK_UNLCK, 1);
+		_close(fd);
+#else
+		flock(fd, LOCK_UN);
+		close(fd);
+#endif
+	}
+	
+private:
+	int fd;
+};
+
+// 当前游戏所属的榜单名，自定义难度按棋盘尺寸和地雷数区分，残局再按残局难度区分
+string leaderboardKey() {
+	string key = gameMode + "/" + gameDifficulty;
+	
+	if (gameDifficulty == "自定义") {
+		key = gameMode + "/" + to_string(rows) + "x" + to_string(cols) + "x" + to_string(mines);
+	}
+	
+	if (gameMode == "残局模式") {
+		key += "/难度" + to_string(residualDifficulty);
+	}
+	
+	return key;
+}
+
+// 榜单中成绩对应的排序键，使排序键越小名次越靠前
+long long rankKey(const LeaderboardTable &table, long long value) {
+	return table.lowerIsBetter ? value : -value;
+}
+
+// 在内存中的榜单里设置某个用户的成绩
+void setLeaderboardValue(LeaderboardTable &table, const string &user, long long value) {
+	auto it = table.values.find(user);
+	
+	if (it != table.values.end()) {
+		table.ranking.erase({rankKey(table, it->second), user});
+	}
+	
+	table.values[user] = value;
+	table.ranking.insert({rankKey(table, value), user});
+}
+
+// 用户名不能为空，也不能包含空白或控制字符，否则排行榜文件中的一行无法按空格拆分
+bool validUserName(const string &name) {
+	if (name.empty()) return false;
+	
+	for (char c : name) {
+		if (isspace((unsigned char)c) || iscntrl((unsigned char)c)) return false;
+	}
+	
+	return true;
+}
+
+// 应用排行榜文件中的一行。格式: 榜单名 越小越好(0/1) 用户名 成绩。
+// 格式错误的行被跳过并记录下来，不影响后面各行的读取
+void applyLeaderboardLine(const string &line) {
+	istringstream iss(line);
+	string key, user, rest;
+	int lowerIsBetter;
+	long long value;
+	
+	if (!(iss >> key >> lowerIsBetter >> user >> value) || (iss >> rest) || !validUserName(user)) {
+		leaderboardComplete = leaderboardComplete && line.find_first_not_of(" \t\r") == string::npos; // 空行不算错误
+		return;
+	}
+	
+	LeaderboardTable &table = leaderboard[key];
+	table.lowerIsBetter = lowerIsBetter != 0;
+	setLeaderboardValue(table, user, value);
+	leaderboardLines++;
+}
+
+// 把排行榜文件中上次读取之后追加的行应用到内存中的榜单（调用方负责加锁），
+// 每行只需 O(log N)。文件被其他进程压缩替换过（标识变了或变短了）时从头重新读取
+void syncLeaderboard() {
+	ifstream file(LEADERBOARD_FILE, ios::binary);
+	string line, id;
+	streamoff start = 0;
+	
+	if (file.peek() == '#') {
+		getline(file, line);
+		istringstream iss(line);
+		iss >> line >> id;
+		start = file.tellg();
+	}
+	
+	file.clear();
+	file.seekg(0, ios::end);
+	streamoff size = file.is_open() ? (streamoff)file.tellg() : 0;
+	
+	if (id != leaderboardFileId || size < leaderboardOffset) {
+		leaderboard.clear();
+		leaderboardFileId = id;
+		leaderboardOffset = start;
+		leaderboardLines = 0;
+		leaderboardComplete = true;
+	}
+	
+	leaderboardTail = false;
+	
+	if (!file.is_open()) return;
+	
+	file.seekg(leaderboardOffset);
+	
+	while (getline(file, line)) {
+		if (file.eof()) {
+			leaderboardTail = true; // 最后一行没有换行符，留到它写完整后再读
+			break;
+		}
+		
+		leaderboardOffset = file.tellg();
+		applyLeaderboardLine(line);
+	}
+}
+
+// 在共享锁下加载排行榜，供查询使用
+void loadLeaderboard() {
+	LeaderboardLock lock(false);
+	syncLeaderboard();
+}
+
+// 压缩排行榜文件：成绩行远多于实际成绩数时，只保留每个用户的当前成绩写入临时文件再整体替换，
+// 并换上新的标识让其他进程重新读取。读取时遇到过无法解析的行就不压缩，以免丢失这些行
+void compactLeaderboard() {
+	long long entries = 0;
+	
+	for (const auto &entry : leaderboard) {
+		entries += entry.second.values.size();
+	}
+	
+	if (!leaderboardComplete || leaderboardLines <= 2 * entries + LEADERBOARD_COMPACT_SLACK) return;
+	
+	random_device seeder;
+	string id = to_string(((unsigned long long)seeder() << 32) | seeder());
+	string tempFile = LEADERBOARD_FILE + ".tmp";
+	ofstream file(tempFile, ios::binary);
+	
+	if (!file.is_open()) return;
+	
+	file << LEADERBOARD_HEADER << " " << id << "\n";
+	
+	for (const auto &entry : leaderboard) {
+		for (const auto &ranked : entry.second.ranking) {
+			file << entry.first << " " << entry.second.lowerIsBetter << " " << ranked.second << " " << entry.second.values.at(ranked.second) << "\n";
+		}
+	}
+	
+	streamoff size = file.tellp();
+	file.close();
+	
+	if (!file) return;
+	
+#ifdef _WIN32
+	remove(LEADERBOARD_FILE.c_str()); // Windows 下 rename 不能覆盖已有文件
+#endif
+	
+	if (rename(tempFile.c_str(), LEADERBOARD_FILE.c_str()) != 0) return;
+	
+	leaderboardFileId = id;
+	leaderboardOffset = size;
+	leaderboardLines = entries;
+}
+
+// 在独占锁下更新排行榜：先读入其他进程追加的成绩，成绩更好时在文件末尾追加一行，
+// 不重写已有内容；追加的行多到一定程度时再压缩文件
+void updateLeaderboard(const string &key, const string &user, long long value, bool keepBest) {
+	if (!validUserName(user)) return;
+	
+	LeaderboardLock lock(true);
+	syncLeaderboard();
+	LeaderboardTable &table = leaderboard[key];
+	
+	if (key != LADDER_BOARD && key != SCORE_BOARD) {
+		table.lowerIsBetter = true; // 经典和残局榜单记录用时
+	}
+	
+	auto it = table.values.find(user);
+	
+	if (keepBest && it != table.values.end() && rankKey(table, it->second) <= rankKey(table, value)) {
+		return; // 已有更好的成绩
+	}
+	
+	string line = key + " " + to_string(table.lowerIsBetter) + " " + user + " " + to_string(value) + "\n";
+	ofstream file(LEADERBOARD_FILE, ios::binary | ios::app);
+	
+	if (leaderboardTail) {
+		file << "\n"; // 补全被中断的那一行，下次读取时它会被当作格式错误跳过
+	}
+	
+	file << line;
+	file.close();
+	
+	if (!file) {
+		cout << "无法保存排行榜。" << endl;
+		return;
+	}
+	
+	setLeaderboardValue(table, user, value);
+	
+	// 补过换行时不移动读取位置，下次连同补全的那一行一起读入
+	if (!leaderboardTail) {
+		leaderboardOffset += line.size();
+		leaderboardLines++;
+	}
+	
+	compactLeaderboard();
+}
+
+// 格式化榜单成绩：用时类显示为秒（精确到毫秒），其余直接显示
+string formatLeaderboardValue(const string &key, long long value) {
+	if (key == LADDER_BOARD) {
+		return to_string(value) + " 层";
+	} else if (key == SCORE_BOARD) {
+		return to_string(value) + " 分";
+	}
+	
+	char text[32];
+	snprintf(text, sizeof(text), "%.3f 秒", value / 1000.0);
+	return text;
+}
+
+// 显示排行榜：每个榜单的前 K 名以及当前用户的名次
+void showLeaderboard() {
+	loadLeaderboard();
+	clearScreen();
+	
+	if (leaderboard.empty()) {
+		cout << "排行榜暂无记录。" << endl;
+	}
+	
+	for (const auto &entry : leaderboard) {
+		const LeaderboardTable &table = entry.second;
+		cout << YELLOW << "【" << entry.first << "】" << RESET << " 共 " << table.values.size() << " 人" << endl;
+		int rank = 1;
+		
+		for (auto it = table.ranking.begin(); it != table.ranking.end() && rank <= LEADERBOARD_TOP_K; ++it, ++rank) {
+			cout << setw(3) << rank << ". " << it->second << "  " << formatLeaderboardValue(entry.first, table.values.at(it->second)) << endl;
+		}
+		
+		auto self = table.values.find(username);
+		
+		if (self != table.values.end()) {
+			size_t myRank = table.ranking.order_of_key({rankKey(table, self->second), username}) + 1;
+			cout << "你的名次: " << myRank << " / " << table.values.size() << endl;
+		}
+		
+		cout << endl;
+	}
+	
+	char choice;
+	
+	while (true) {
+		cout << "输入 'm' 返回菜单: ";
+		cin >> choice;
+		
+		if (cin.fail()) {
+			handleInvalidInput();
+			continue;
+		}
+		
 		if (choice == 'm') {
 			clearScreen();
 			showMenu();
@@ -591,6 +1947,10 @@ void showHistory() {
 
 // 处理无效输入
 void handleInvalidInput() {
+	if (cin.eof()) {
+		logout(); // 输入已经结束（如脚本播放完毕），保存积分后退出
+	}
+	
 	cin.clear(); // 清除错误状态
 	//cin.ignore(numeric_limits<streamsize>::max(), '\n'); // 清除输入缓冲区
 }
@@ -602,58 +1962,60 @@ void ladderMode() {
 	cols = EASY;
 	mines = 5; // 初始地雷数量为简单难度
 	gameDifficulty = "简单";
+	LevelCandidate nextLevel; // 从候选中选出的下一层棋盘
+	bool haveNextLevel = false;
 	
 	while (true) {
 		initializeGame();
-		placeMines();
-		calculateNumbers();
-		startTime = chrono::steady_clock::now();
+		
+		if (haveNextLevel) {
+			loadLadderCandidate(nextLevel);
+			haveNextLevel = false;
+		} else {
+			placeMines();
+			calculateNumbers();
+		}
+		
+		planLadderCandidates(); // 玩家解这一层时在后台评估下一层的候选棋盘
+		startGameClock();
 		
 		while (true) {
-			clearScreen();
-			printBoard();
-			char action;
-			cout << "输入操作 (l 为左键点击, r 为右键点击, t 为使用道具): ";
-			string input;
-			getline(cin, input);
-			
-			// 检查输入是否有效
-			if (input.empty()) {
-				handleInvalidInput();
-				continue;
-			}
-			
-			istringstream iss(input);
-			iss >> action;
+#ifdef COUNT_ALLOCATIONS
+			long long allocationsBefore = allocationCount;
+			int generationBefore = gameGeneration;
+#endif
 			
-			if (action == 'l' || action == 'r' || action == 't') {
+			if (interactiveInput) {
 				int x = -1, y = -1;
+				char action = waitForAction(x, y, true);
+				applyAction(action, x, y);
+			} else {
+				if (!quietMode && !inputPending()) {
+					showCommandPrompt(true);
+				}
 				
-				if (action == 'l' || action == 'r') {
-					// 检查输入是否包含两个有效数字
-					if (!(iss >> x >> y) || !iss.eof()) {
-						handleInvalidInput();
-						continue;
-					}
-					
-					if (action == 'l') {
-						leftClick(x, y); // 左键点击
-					} else if (action == 'r') {
-						rightClick(x, y); // 右键点击
-					}
-				} else if (action == 't') {
-					// 检查输入是否只有 't'
-					if (iss >> x || !iss.eof()) {
-						handleInvalidInput();
-					} else {
-						useItem(); // 使用道具
-					}
+				markInputReady();
+				
+				// 检查输入是否有效；读取失败时 getline 不会清空缓冲区，需要单独判断
+				if (!getline(cin, commandLine) || commandLine.empty()) {
+					handleInvalidInput();
+					continue;
 				}
-			} else {
-				handleInvalidInput();
-				continue;
+				
+				CommandReader reader = {commandLine.data(), commandLine.data() + commandLine.size()};
+				
+				if (!runCommandBatch(reader, true, 0)) {
+					handleInvalidInput();
+					continue;
+				}
+				
+				dirtyCells.clear(); // 命令模式总是整屏渲染，不需要局部重绘的记录
 			}
 			
+#ifdef COUNT_ALLOCATIONS
+			countMoveAllocations(allocationsBefore, generationBefore);
+#endif
+			
 			if (checkWin()) {
 				// 询问是否继续下一层或返回菜单
 				char choice;
@@ -662,15 +2024,29 @@ void ladderMode() {
 					cout << "游戏胜利。输入 'c' 继续下一层，或输入 'm' 返回菜单: ";
 					cin >> choice;
 					
+					if (cin.fail()) {
+						handleInvalidInput();
+						continue;
+					}
+					
 					if (choice == 'c') {
 						currentLevel++; // 增加层数
-						mines += 5; // 增加地雷数量
+						haveNextLevel = takeLadderLevel(currentLevel, nextLevel);
 						
-						// 如果地雷数量达到极限，稍微扩大棋盘并重置地雷数量
-						if (mines >= rows * cols) {
-							rows += 2;
-							cols += 2;
-							mines = 10; // 重置地雷数量为简单难度
+						if (haveNextLevel) {
+							rows = nextLevel.puzzle.rows;
+							cols = nextLevel.puzzle.cols;
+							mines = nextLevel.puzzle.mines;
+						} else {
+							// 候选还没有评估完时按原来的规则增加地雷数量，不让玩家等待
+							mines += 5;
+							
+							// 如果地雷数量达到极限，稍微扩大棋盘并重置地雷数量
+							if (mines >= rows * cols) {
+								rows += 2;
+								cols += 2;
+								mines = 10; // 重置地雷数量为简单难度
+							}
 						}
 						
 						break;
@@ -698,6 +2074,8 @@ void saveScore() {
 	} else {
 		cout << "无法保存积分。" << endl;
 	}
+	
+	updateLeaderboard(SCORE_BOARD, username, score, false); // 积分榜记录当前积分
 }
 
 // 加载积分
@@ -714,6 +2092,7 @@ void loadScore() {
 
 // 使用道具
 void useItem() {
+	disableRawMode(); // 道具菜单用 cin 读取整行
 	int choice;
 	
 	while (true) {
@@ -722,7 +2101,8 @@ void useItem() {
 		cout << "选择道具:" << endl;
 		cout << "1. 复活甲（使用后下一次踩到地雷游戏不会结束而是继续正常进行，消耗30积分）" << endl;
 		cout << "2. 地雷扫描仪（随机揭露两颗地雷的位置，消耗50积分）" << endl;
-		cout << "3. 退出" << endl;
+		cout << "3. 概率热图（本层棋盘上显示每个格子的地雷概率，并随每步操作更新，消耗40积分）" << endl;
+		cout << "4. 退出" << endl;
 		cout << "请输入选择: ";
 		
 		// 读取用户输入
@@ -761,6 +2141,21 @@ void useItem() {
 			break;
 			
 		case 3:
+			if (heatmapActive) {
+				clearScreen();
+				cout << "本层已经在使用概率热图。" << endl;
+			} else if (score >= 40) {
+				score -= 40; // 消耗40积分
+				probabilityHeatmap();
+				return; // 自动跳转回棋盘页面
+			} else {
+				clearScreen();
+				cout << "积分不足，无法使用概率热图道具。" << endl;
+			}
+			
+			break;
+			
+		case 4:
 			return; // 退出道具选择界面
 			
 		default:
@@ -773,23 +2168,11 @@ void useItem() {
 // 地雷扫描仪道具
 void mineScanner() {
 	int revealedCount = 0;
-	vector<pair<int, int>> minePositions;
-	
-	// 收集所有地雷的位置
-	for (int i = 0; i < rows; ++i) {
-		for (int j = 0; j < cols; ++j) {
-			if (board[i][j] == 'M') {
-				minePositions.push_back({i, j});
-			}
-		}
-	}
 	
-	// 随机揭露两颗地雷的位置
-	while (revealedCount < 2 && !minePositions.empty()) {
-		int index = rand() % minePositions.size();
-		auto [x, y] = minePositions[index];
-		revealed[x][y] = true;
-		minePositions.erase(minePositions.begin() + index);
+	// 随机揭露两颗地雷的位置，直接从维护好的未揭开地雷索引中抽取，无需扫描棋盘
+	while (revealedCount < 2 && !hiddenMines.empty()) {
+		int cell = hiddenMines[rand() % hiddenMines.size()];
+		markRevealed(cell / cols, cell % cols); // 同时从索引中移除
 		revealedCount++;
 	}
 	
@@ -804,42 +2187,2984 @@ void revive() {
 	cout << "复活甲道具已使用，下一次踩到地雷游戏不会结束。" << endl;
 }
 
-// 经典和残局模式
-void classicAndResidualMode() {
-	initializeGame();
-	placeMines();
-	calculateNumbers();
-	startTime = chrono::steady_clock::now();
+#ifndef _WIN32
+// 收到中断信号时恢复终端设置后退出，避免终端停留在原始模式
+void restoreTerminalOnSignal(int sig) {
+	tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+	ssize_t written = write(STDOUT_FILENO, "\033[?25h\n", 7);
+	(void)written;
+	_exit(128 + sig);
+}
+#endif
+
+// 进入原始模式：关闭行缓冲和回显，按键无需回车即可读取
+void enableRawMode() {
+	if (rawModeActive) return;
 	
-	while (true) {
-		clearScreen();
-		printBoard();
-		char action;
-		cout << "输入操作 (l 为左键点击, r 为右键点击): ";
-		string input;
-		getline(cin, input);
-		istringstream iss(input);
-		iss >> action;
-		
-		if (action == 'l' || action == 'r') {
-			int x, y;
-			iss >> x >> y;
-			
-			if (iss.fail()) {
-				handleInvalidInput();
-				continue;
+#ifndef _WIN32
+	if (!originalTermiosSaved) {
+		tcgetattr(STDIN_FILENO, &originalTermios);
+		originalTermiosSaved = true;
+		signal(SIGINT, restoreTerminalOnSignal);
+		signal(SIGTERM, restoreTerminalOnSignal);
+	}
+	
+	struct termios raw = originalTermios;
+	raw.c_lflag &= ~(ICANON | ECHO); // 保留 ISIG，Ctrl+C 仍然有效
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+#endif
+	rawModeActive = true;
+	cout << HIDE_CURSOR << flush;
+}
+
+// 恢复进入原始模式前的终端设置，之后的提示可以继续使用 cin 读取整行
+void disableRawMode() {
+	if (!rawModeActive) return;
+	
+#ifndef _WIN32
+	tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+#endif
+	rawModeActive = false;
+	cout << SHOW_CURSOR << flush;
+}
+
+// 等待一个按键，最多等待 timeoutMs 毫秒，超时返回 KEY_NONE
+int readKey(int timeoutMs) {
+#ifdef _WIN32
+	auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+	
+	while (!_kbhit()) {
+		if (chrono::steady_clock::now() >= deadline) return KEY_NONE;
+		
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	
+	int c = _getch();
+	
+	// 方向键以 0 或 224 开头，第二个字节为扫描码
+	if (c == 0 || c == 224) {
+		switch (_getch()) {
+		case 72:
+			return KEY_UP;
+			
+		case 80:
+			return KEY_DOWN;
+			
+		case 75:
+			return KEY_LEFT;
+			
+		case 77:
+			return KEY_RIGHT;
+			
+		default:
+			return KEY_NONE;
+		}
+	}
+	
+	return c;
+#else
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	
+	if (poll(&pfd, 1, timeoutMs) <= 0) return KEY_NONE;
+	
+	unsigned char c;
+	
+	if (read(STDIN_FILENO, &c, 1) != 1) return KEY_NONE;
+	
+	if (c != 27) return c;
+	
+	// 方向键以 ESC [ A~D 序列发送，短暂等待剩余的字节
+	unsigned char seq[2];
+	
+	if (poll(&pfd, 1, 10) <= 0 || read(STDIN_FILENO, &seq[0], 1) != 1) return 27;
+	
+	if (poll(&pfd, 1, 10) <= 0 || read(STDIN_FILENO, &seq[1], 1) != 1) return 27;
+	
+	if (seq[0] == '[' || seq[0] == 'O') {
+		switch (seq[1]) {
+		case 'A':
+			return KEY_UP;
+			
+		case 'B':
+			return KEY_DOWN;
+			
+		case 'C':
+			return KEY_RIGHT;
+			
+		case 'D':
+			return KEY_LEFT;
+		}
+	}
+	
+	return KEY_NONE;
+#endif
+}
+
+// 将终端光标移动到指定的行和列（从 1 开始）
+void moveCursorTo(int row, int col) {
+	cout << "\033[" << row << ";" << col << "H";
+}
+
+// 记录需要局部重绘的格子。记录已满时改为整屏重绘，不再扩容：一批命令改变的格子可能比棋盘还多
+void markDirty(int x, int y) {
+	if (dirtyCells.size() == dirtyCells.capacity()) {
+		dirtyCells.clear();
+		screenDirty = true;
+	}
+	
+	dirtyCells.push_back({x, y});
+}
+
+// 局部重绘单个格子，位置与 printBoard 的排版一致
+void drawCell(int i, int j) {
+	int maxRowWidth = to_string(rows - 1).length();
+	int cellWidth = max((int)to_string(cols - 1).length(), 2);
+	moveCursorTo(i + 2, maxRowWidth + 2 + j * (cellWidth + 1));
+	renderBuffer.clear();
+	printCell(i, j, cellWidth, i == cursorX && j == cursorY);
+	cout.write(renderBuffer.data(), renderBuffer.size());
+}
+
+// 局部重绘棋盘下方的状态行，计时器精确到毫秒
+void drawStatusLine() {
+	double elapsed = gameSeconds();
+	char timer[32];
+	snprintf(timer, sizeof(timer), "%.3f", elapsed);
+	moveCursorTo(rows + 2, 1);
+	cout << "用时: " << timer << " 秒  剩余地雷: " << mines - flagCount << "  光标: (" << cursorX << ", " << cursorY << ")" << CLEAR_LINE << flush;
+}
+
+// 整屏重绘：棋盘、状态行和操作说明
+void drawFullScreen(bool allowItem) {
+	cout << "\033[H\033[2J";
+	printBoard();
+	cout << endl; // 状态行由 drawStatusLine 填充
+	cout << "方向键/WASD 移动光标, 回车揭开, 空格标记";
+	
+	if (allowItem) {
+		cout << ", t 使用道具";
+	}
+	
+	if (undoActive()) {
+		cout << ", u 悔棋, y 重做";
+	}
+	
+	if (hintActive()) {
+		cout << ", p 概率提示";
+	}
+	
+	cout << endl;
+	
+	if (!statusMessage.empty()) {
+		cout << statusMessage << endl;
+		statusMessage.clear();
+	}
+	
+	dirtyCells.clear();
+	screenDirty = false;
+}
+
+// 按键事件循环：轮询标准输入，期间刷新计时器并局部重绘变化的格子，
+// 直到玩家在光标处揭开或标记格子（或使用道具）时返回对应的操作。
+// 返回后仍保持原始模式，执行操作期间的按键不会回显；需要用 cin 读取的道具菜单和结算画面自行退出原始模式
+char waitForAction(int &x, int &y, bool allowItem) {
+	enableRawMode();
+	bool ready = false;
+	
+	while (true) {
+		refreshHeatmap(); // 热图过期时会标记整屏重绘
+		
+		if (screenDirty) {
+			drawFullScreen(allowItem);
+		} else {
+			for (const auto &cell : dirtyCells) {
+				drawCell(cell.first, cell.second);
+			}
+			
+			dirtyCells.clear();
+		}
+		
+		drawStatusLine();
+		
+		if (!ready) {
+			markInputReady(); // 上一步的重绘已经完成
+			ready = true;
+		}
+		
+		int key = readKey(TIMER_REFRESH_MS);
+		
+		if (key == KEY_NONE) continue;
+		
+		int oldX = cursorX, oldY = cursorY;
+		
+		switch (key) {
+		case KEY_UP:
+		case 'w':
+			cursorX = max(cursorX - 1, 0);
+			break;
+			
+		case KEY_DOWN:
+		case 's':
+			cursorX = min(cursorX + 1, rows - 1);
+			break;
+			
+		case KEY_LEFT:
+		case 'a':
+			cursorY = max(cursorY - 1, 0);
+			break;
+			
+		case KEY_RIGHT:
+		case 'd':
+			cursorY = min(cursorY + 1, cols - 1);
+			break;
+			
+		case '\n':
+		case '\r':
+			x = cursorX;
+			y = cursorY;
+			return 'l';
+			
+		case ' ':
+			x = cursorX;
+			y = cursorY;
+			return 'r';
+			
+		case 't':
+			if (allowItem) {
+				return 't';
+			}
+			
+			break;
+			
+		case 'u':
+		case 'y':
+			if (undoActive()) {
+				return key;
+			}
+			
+			break;
+			
+		case 'p':
+			if (hintActive()) {
+				return 'p';
+			}
+			
+			break;
+		}
+		
+		if (oldX != cursorX || oldY != cursorY) {
+			markDirty(oldX, oldY);
+			markDirty(cursorX, cursorY);
+		}
+	}
+}
+
+// 输入缓冲区中是否还有尚未处理的命令（例如通过管道一次性写入的脚本）
+bool inputPending() {
+	return cin.rdbuf()->in_avail() > 0;
+}
+
+// 渲染棋盘并提示输入命令
+void showCommandPrompt(bool allowItem) {
+	clearScreen();
+	printBoard();
+	
+	if (!statusMessage.empty()) {
+		cout << statusMessage << endl;
+		statusMessage.clear();
+	}
+	
+	cout << "输入操作 (l 为左键点击, r 为右键点击";
+	
+	if (allowItem) {
+		cout << ", t 为使用道具";
+	}
+	
+	if (undoActive()) {
+		cout << ", u 为悔棋（用时加 " << UNDO_PENALTY_SECONDS << " 秒）, y 为重做";
+	}
+	
+	if (hintActive()) {
+		cout << ", p 为概率提示（用时加 " << HINT_PENALTY_SECONDS << " 秒）";
+	}
+	
+	cout << ", e 为导出棋盘, f 为执行命令文件，一行可输入多条命令): " << flush;
+}
+
+// 执行一步操作（l 左键点击、r 右键点击、t 使用道具、u 悔棋、y 重做、p 概率提示）并记录它的耗时
+void applyAction(char action, int x, int y) {
+#ifdef COUNT_ALLOCATIONS
+	if (action == 't' || action == 'p') toolBatch = true;
+#endif
+	
+	beginTimedMove(action, x, y);
+	
+	if (action == 'l') {
+		leftClick(x, y); // 左键点击
+	} else if (action == 'r') {
+		rightClick(x, y); // 右键点击
+	} else if (action == 't') {
+		useItem(); // 使用道具
+	} else if (action == 'u') {
+		undoMove(); // 悔棋
+	} else if (action == 'y') {
+		redoMove(); // 重做
+	} else if (action == 'p') {
+		showProbabilityHint(); // 概率提示
+	}
+	
+	endTimedMove();
+}
+
+// 按顺序执行一批命令（l x y、r x y、t、f 文件），期间不渲染棋盘。
+// 游戏胜利或踩雷后换局时停止执行剩余命令；遇到无效命令时返回 false。
+bool runCommandBatch(CommandReader &in, bool allowItem, int depth) {
+	int generation = gameGeneration;
+	char action;
+	
+	while (in.readChar(action)) {
+		if (action == 'l' || action == 'r') {
+			int x, y;
+			
+			if (!in.readInt(x) || !in.readInt(y)) return false;
+			
+			applyAction(action, x, y);
+		} else if ((action == 't' && allowItem) || ((action == 'u' || action == 'y') && undoActive()) || (action == 'p' && hintActive())) {
+			applyAction(action, -1, -1);
+		} else if (action == 'e') {
+#ifdef COUNT_ALLOCATIONS
+			toolBatch = true;
+#endif
+			string path;
+			
+			if (!in.readWord(path)) return false;
+			
+			statusMessage = exportBoard(path) ? "棋盘已导出到 " + path : "无法导出棋盘到 " + path;
+		} else if (action == 'f' && depth < MAX_SCRIPT_DEPTH) {
+#ifdef COUNT_ALLOCATIONS
+			toolBatch = true;
+#endif
+			string path;
+			
+			if (!in.readWord(path)) return false;
+			
+			ifstream script(path);
+			
+			if (!script.is_open()) return false;
+			
+			string content((istreambuf_iterator<char>(script)), istreambuf_iterator<char>());
+			CommandReader reader = {content.data(), content.data() + content.size()};
+			
+			if (!runCommandBatch(reader, allowItem, depth + 1)) return false;
+		} else {
+			return false;
+		}
+		
+		if (gameGeneration != generation || isGameWon()) break;
+	}
+	
+	return true;
+}
+
+// 当前游戏是否可以悔棋
+bool undoActive() {
+	return allowUndo && (gameMode == "经典模式" || gameMode == "残局模式");
+}
+
+// 开始记录一步操作：丢弃已撤销的操作，它们不能再被重做；记录已满时原地丢弃较早的一半
+void beginMove() {
+	if (!undoActive()) return;
+	
+	if (moveLogSize < moveLog.size()) {
+		moveCells.resize(moveLogSize == 0 ? 0 : moveLog[moveLogSize - 1].cellEnd);
+		moveLog.resize(moveLogSize);
+	}
+	
+	if (moveLog.size() < undoHistory) return;
+	
+	size_t dropped = moveLog.size() / 2;
+	int droppedCells = moveLog[dropped - 1].cellEnd;
+	moveLog.erase(moveLog.begin(), moveLog.begin() + dropped);
+	moveCells.erase(moveCells.begin(), moveCells.begin() + droppedCells);
+	
+	for (auto &move : moveLog) {
+		move.cellEnd -= droppedCells;
+	}
+	
+	moveLogSize = moveLog.size();
+}
+
+// 结束记录一步操作，该步改变的格子已追加到 moveCells 末尾
+void recordMove(char action) {
+	if (!undoActive()) return;
+	
+	moveLog.push_back({(int)moveCells.size(), action});
+	moveLogSize = moveLog.size();
+}
+
+// 撤销上一步操作，只恢复该步改变的格子和计数器；每次悔棋由 gameSeconds 在本局用时上加 UNDO_PENALTY_SECONDS 秒
+void undoMove() {
+	if (!undoActive() || moveLogSize == 0) return;
+	
+	const MoveDelta &move = moveLog[--moveLogSize];
+	int cellBegin = moveLogSize == 0 ? 0 : moveLog[moveLogSize - 1].cellEnd;
+	
+	for (int k = cellBegin; k < move.cellEnd; ++k) {
+		int x = moveCells[k] / cols;
+		int y = moveCells[k] % cols;
+		
+		if (move.action == 'l') {
+			revealed[x][y] = false; // 洪水填充只会揭开非地雷格子
+		} else {
+			flagged[x][y] = !flagged[x][y];
+			flagCount += flagged[x][y] ? 1 : -1;
+		}
+		
+		markDirty(x, y);
+	}
+	
+	if (move.action == 'l') {
+		revealedCount -= move.cellEnd - cellBegin;
+		leftClickCount--;
+	} else {
+		rightClickCount--;
+	}
+	
+	undoCount++; // 每次悔棋的用时惩罚由 gameSeconds 计入
+	analyzer.stale = true; // 分析器只支持增量揭开，悔棋后需要重建
+}
+
+// 重做最近一次撤销的操作
+void redoMove() {
+	if (!undoActive() || moveLogSize == moveLog.size()) return;
+	
+	int cellBegin = moveLogSize == 0 ? 0 : moveLog[moveLogSize - 1].cellEnd;
+	const MoveDelta &move = moveLog[moveLogSize++];
+	
+	for (int k = cellBegin; k < move.cellEnd; ++k) {
+		int x = moveCells[k] / cols;
+		int y = moveCells[k] % cols;
+		
+		if (move.action == 'l') {
+			revealed[x][y] = true;
+		} else {
+			flagged[x][y] = !flagged[x][y];
+			flagCount += flagged[x][y] ? 1 : -1;
+		}
+		
+		markDirty(x, y);
+	}
+	
+	if (move.action == 'l') {
+		revealedCount += move.cellEnd - cellBegin;
+		leftClickCount++;
+	} else {
+		rightClickCount++;
+	}
+	
+	analyzer.stale = true;
+}
+
+// 根据当前棋盘上可见的信息建立约束模型
+ConstraintModel buildConstraintModel() {
+	ConstraintModel model;
+	vector<int> varOf(rows * cols, -1);
+	int knownMines = 0; // 已揭开的地雷（如地雷扫描仪揭露的）
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (!revealed[i][j]) {
+				varOf[i * cols + j] = model.cells.size();
+				model.cells.push_back(i * cols + j);
+			} else if (board[i][j] == 'M') {
+				knownMines++;
+			}
+		}
+	}
+	
+	model.minesLeft = mines - knownMines;
+	model.varConstraints.resize(model.cells.size());
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (!revealed[i][j] || board[i][j] == 'M') continue;
+			
+			int need = board[i][j] - '0';
+			vector<int> vars;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = i + dx;
+					int ny = j + dy;
+					
+					if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+					
+					if (!revealed[nx][ny]) {
+						vars.push_back(varOf[nx * cols + ny]);
+					} else if (board[nx][ny] == 'M') {
+						need--;
+					}
+				}
+			}
+			
+			if (vars.empty()) continue;
+			
+			for (int v : vars) {
+				model.varConstraints[v].push_back(model.constraintVars.size());
+			}
+			
+			model.constraintVars.push_back(vars);
+			model.constraintNeed.push_back(need);
+		}
+	}
+	
+	return model;
+}
+
+// 单个线程的采样过程：在未知格子上做保持地雷总数不变的交换（Metropolis 算法），
+// 能量为违反约束的总量；每轮扫描后若能量为 0 则记录一次样本。
+// 平稳分布限制在能量为 0 的配置上时恰好是所有合法配置的均匀分布。
+void sampleConstraintModel(const ConstraintModel &model, chrono::steady_clock::time_point deadline, unsigned seed, SamplerResult &result) {
+	int n = model.cells.size();
+	int m = model.minesLeft;
+	result.mineCounts.assign(n, 0);
+	result.batchSum.assign(n, 0);
+	result.batchSumSq.assign(n, 0);
+	
+	if (n == 0 || m < 0 || m > n) return;
+	
+	mt19937 rng(seed);
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+	vector<int> order(n);
+	iota(order.begin(), order.end(), 0);
+	shuffle(order.begin(), order.end(), rng);
+	
+	// 随机放置初始地雷，mineList 和 freeList 分别保存是地雷和不是地雷的变量
+	vector<int> mineList(order.begin(), order.begin() + m);
+	vector<int> freeList(order.begin() + m, order.end());
+	vector<int> count(model.constraintVars.size(), 0);
+	
+	for (int v : mineList) {
+		for (int c : model.varConstraints[v]) {
+			count[c]++;
+		}
+	}
+	
+	int energy = 0;
+	
+	for (size_t c = 0; c < count.size(); ++c) {
+		energy += abs(count[c] - model.constraintNeed[c]);
+	}
+	
+	// 预先计算常用的接受概率
+	double acceptance[17];
+	
+	for (int dE = 0; dE < 17; ++dE) {
+		acceptance[dE] = exp(-SAMPLER_BETA * dE);
+	}
+	
+	vector<int> batchCounts(n, 0);
+	int batchSamples = 0;
+	
+	while (true) {
+		// 地雷数为 0 或全为地雷时只有一种配置，无需交换
+		for (int step = 0; step < n && m > 0 && m < n; ++step) {
+			int ai = rng() % m;
+			int bi = rng() % (n - m);
+			int a = mineList[ai];
+			int b = freeList[bi];
+			int dE = 0;
+			
+			for (int c : model.varConstraints[a]) {
+				int need = model.constraintNeed[c];
+				dE += abs(count[c] - 1 - need) - abs(count[c] - need);
+				count[c]--;
+			}
+			
+			for (int c : model.varConstraints[b]) {
+				int need = model.constraintNeed[c];
+				dE += abs(count[c] + 1 - need) - abs(count[c] - need);
+				count[c]++;
+			}
+			
+			if (dE <= 0 || uniform(rng) < acceptance[min(dE, 16)]) {
+				mineList[ai] = b;
+				freeList[bi] = a;
+				energy += dE;
+			} else {
+				// 拒绝交换，恢复约束计数
+				for (int c : model.varConstraints[b]) {
+					count[c]--;
+				}
+				
+				for (int c : model.varConstraints[a]) {
+					count[c]++;
+				}
+			}
+		}
+		
+		if (energy == 0) {
+			result.samples++;
+			batchSamples++;
+			
+			for (int v : mineList) {
+				result.mineCounts[v]++;
+				batchCounts[v]++;
+			}
+			
+			// 一批样本采满后记录该批的地雷频率
+			if (batchSamples == SAMPLER_BATCH_SIZE) {
+				for (int v = 0; v < n; ++v) {
+					double p = (double)batchCounts[v] / batchSamples;
+					result.batchSum[v] += p;
+					result.batchSumSq[v] += p * p;
+					batchCounts[v] = 0;
+				}
+				
+				result.batches++;
+				batchSamples = 0;
+			}
+		}
+		
+		if (chrono::steady_clock::now() >= deadline || ((m == 0 || m == n) && result.samples > 0)) break;
+	}
+}
+
+// 多线程蒙特卡洛估计每个未揭开格子的地雷概率，在时间预算内尽可能多地采样。
+// 马尔可夫链的相邻样本相关，置信区间取二项分布误差与批均值误差中较大者
+ProbabilityEstimate estimateMineProbabilities(const ConstraintModel &model, int timeBudgetMs) {
+	auto begin = chrono::steady_clock::now();
+	auto deadline = begin + chrono::milliseconds(timeBudgetMs);
+	int n = model.cells.size();
+	int threadCount = max(1u, thread::hardware_concurrency());
+	vector<SamplerResult> results(threadCount);
+	vector<thread> workers;
+	random_device seeder;
+	
+	for (int t = 0; t < threadCount; ++t) {
+		workers.emplace_back(sampleConstraintModel, cref(model), deadline, seeder(), ref(results[t]));
+	}
+	
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	
+	ProbabilityEstimate estimate;
+	estimate.cells.assign(rows * cols, {-1, -1, -1});
+	estimate.threads = threadCount;
+	
+	int batches = 0;
+	
+	for (const auto &result : results) {
+		estimate.samples += result.samples;
+		batches += result.batches;
+	}
+	
+	for (int v = 0; v < n; ++v) {
+		CellProbability &cell = estimate.cells[model.cells[v]];
+		
+		if (estimate.samples == 0) {
+			// 时间预算内没有找到合法配置，退化为平均密度，置信区间为 [0, 1]
+			cell = {(double)model.minesLeft / n, 0.0, 1.0};
+			continue;
+		}
+		
+		long long total = 0;
+		double batchSum = 0, batchSumSq = 0;
+		
+		for (const auto &result : results) {
+			total += result.mineCounts[v];
+			batchSum += result.batchSum[v];
+			batchSumSq += result.batchSumSq[v];
+		}
+		
+		double p = (double)total / estimate.samples;
+		double variance = p * (1 - p) / estimate.samples;
+		
+		if (batches >= 2) {
+			double mean = batchSum / batches;
+			double batchVariance = max(0.0, (batchSumSq - batches * mean * mean) / (batches - 1));
+			variance = max(variance, batchVariance / batches);
+		}
+		
+		double half = 1.96 * sqrt(variance);
+		cell = {p, max(0.0, p - half), min(1.0, p + half)};
+	}
+	
+	estimate.elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin).count();
+	return estimate;
+}
+
+// 揭开一个格子，同步更新地雷索引和前沿分析器
+void markRevealed(int x, int y) {
+	if (revealed[x][y]) return;
+	
+	revealed[x][y] = true;
+	markDirty(x, y);
+	int cell = x * cols + y;
+	
+	if (hiddenMineIndex[cell] >= 0) {
+		// 与末尾元素交换后删除，O(1)
+		int last = hiddenMines.back();
+		hiddenMines[hiddenMineIndex[cell]] = last;
+		hiddenMineIndex[last] = hiddenMineIndex[cell];
+		hiddenMines.pop_back();
+		hiddenMineIndex[cell] = -1;
+	}
+	
+	if (!analyzer.stale) {
+		analyzerReveal(cell);
+	}
+}
+
+// 建立未揭开地雷的位置索引，在放置地雷之后调用
+void indexMines() {
+	hiddenMines.clear();
+	hiddenMineIndex.assign(rows * cols, -1);
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (board[i][j] == 'M' && !revealed[i][j]) {
+				hiddenMineIndex[i * cols + j] = hiddenMines.size();
+				hiddenMines.push_back(i * cols + j);
+			}
+		}
+	}
+}
+
+// 向带下标索引的集合中加入元素
+void indexedInsert(vector<int> &list, vector<int> &index, int cell) {
+	if (index[cell] >= 0) return;
+	
+	index[cell] = list.size();
+	list.push_back(cell);
+}
+
+// 从带下标索引的集合中删除元素（与末尾元素交换后删除）
+void indexedErase(vector<int> &list, vector<int> &index, int cell) {
+	if (index[cell] < 0) return;
+	
+	int last = list.back();
+	list[index[cell]] = last;
+	index[last] = index[cell];
+	list.pop_back();
+	index[cell] = -1;
+}
+
+// 从头重建前沿分析器，只在新开局后第一次使用或悔棋之后调用
+void rebuildAnalyzer() {
+	int total = rows * cols;
+	analyzer.unknownNeighbours.assign(total, 0);
+	analyzer.numberNeighbours.assign(total, 0);
+	analyzer.mineNeighbours.assign(total, 0);
+	analyzer.frontier.clear();
+	analyzer.frontier.reserve(total); // 增量更新时不再扩容
+	analyzer.frontierIndex.assign(total, -1);
+	analyzer.numbers.clear();
+	analyzer.numbers.reserve(total);
+	analyzer.numberIndex.assign(total, -1);
+	analyzer.varOf.assign(total, -1);
+	analyzer.unknownCount = 0;
+	analyzer.revealedMines = 0;
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (!revealed[i][j]) {
+				analyzer.unknownCount++;
+			} else if (board[i][j] == 'M') {
+				analyzer.revealedMines++;
+			}
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = i + dx;
+					int ny = j + dy;
+					
+					if ((dx == 0 && dy == 0) || nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+					
+					if (!revealed[nx][ny]) {
+						analyzer.unknownNeighbours[i * cols + j]++;
+					} else if (board[nx][ny] == 'M') {
+						analyzer.mineNeighbours[i * cols + j]++;
+					} else {
+						analyzer.numberNeighbours[i * cols + j]++;
+					}
+				}
+			}
+		}
+	}
+	
+	for (int cell = 0; cell < total; ++cell) {
+		bool isRevealed = revealed[cell / cols][cell % cols];
+		bool isMine = board[cell / cols][cell % cols] == 'M';
+		
+		if (!isRevealed && analyzer.numberNeighbours[cell] > 0) {
+			indexedInsert(analyzer.frontier, analyzer.frontierIndex, cell);
+		} else if (isRevealed && !isMine && analyzer.unknownNeighbours[cell] > 0) {
+			indexedInsert(analyzer.numbers, analyzer.numberIndex, cell);
+		}
+	}
+	
+	analyzer.stale = false;
+	analyzer.version++;
+}
+
+// 增量更新：格子 cell 刚被揭开，只需要更新它自己和周围 8 个邻居的状态
+void analyzerReveal(int cell) {
+	int x = cell / cols;
+	int y = cell % cols;
+	bool isMine = board[x][y] == 'M';
+	indexedErase(analyzer.frontier, analyzer.frontierIndex, cell);
+	analyzer.unknownCount--;
+	
+	if (isMine) {
+		analyzer.revealedMines++;
+	} else if (analyzer.unknownNeighbours[cell] > 0) {
+		indexedInsert(analyzer.numbers, analyzer.numberIndex, cell);
+	}
+	
+	for (int dx = -1; dx <= 1; ++dx) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			int nx = x + dx;
+			int ny = y + dy;
+			
+			if ((dx == 0 && dy == 0) || nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+			
+			int neighbour = nx * cols + ny;
+			
+			if (--analyzer.unknownNeighbours[neighbour] == 0) {
+				indexedErase(analyzer.numbers, analyzer.numberIndex, neighbour);
+			}
+			
+			if (isMine) {
+				analyzer.mineNeighbours[neighbour]++;
+			} else if (++analyzer.numberNeighbours[neighbour] == 1 && !revealed[nx][ny]) {
+				indexedInsert(analyzer.frontier, analyzer.frontierIndex, neighbour);
+			}
+		}
+	}
+	
+	analyzer.version++;
+}
+
+// 由分析器维护的前沿和数字格子生成约束模型：变量只包括前沿格子，
+// 其余未揭开的格子彼此等价，只记录数量
+ConstraintModel buildFrontierModel() {
+	ConstraintModel model;
+	model.cells = analyzer.frontier;
+	model.varConstraints.resize(model.cells.size());
+	model.minesLeft = mines - analyzer.revealedMines;
+	model.interiorCount = analyzer.unknownCount - model.cells.size();
+	
+	for (size_t v = 0; v < model.cells.size(); ++v) {
+		analyzer.varOf[model.cells[v]] = v;
+	}
+	
+	for (int cell : analyzer.numbers) {
+		int x = cell / cols;
+		int y = cell % cols;
+		vector<int> vars;
+		
+		for (int dx = -1; dx <= 1; ++dx) {
+			for (int dy = -1; dy <= 1; ++dy) {
+				int nx = x + dx;
+				int ny = y + dy;
+				
+				if (nx < 0 || nx >= rows || ny < 0 || ny >= cols || revealed[nx][ny]) continue;
+				
+				vars.push_back(analyzer.varOf[nx * cols + ny]);
+			}
+		}
+		
+		for (int v : vars) {
+			model.varConstraints[v].push_back(model.constraintVars.size());
+		}
+		
+		model.constraintVars.push_back(vars);
+		model.constraintNeed.push_back(board[x][y] - '0' - analyzer.mineNeighbours[cell]);
+	}
+	
+	for (int cell : model.cells) {
+		analyzer.varOf[cell] = -1;
+	}
+	
+	return model;
+}
+
+// 一个连通块的全部解，按块内地雷数 k 分组
+struct ComponentSolutions {
+	vector<int> vars; // 块内的变量，按搜索顺序排列
+	vector<double> count; // count[k]：块内恰有 k 颗地雷的解的数量
+	vector<vector<double>> mineCount; // mineCount[k][i]：这些解中 vars[i] 为地雷的次数
+};
+
+// 回溯枚举一个连通块的所有解，nodes 为剩余的搜索节点预算
+bool enumerateComponent(const ConstraintModel &model, ComponentSolutions &component, size_t depth, vector<int> &assigned, vector<int> &unassigned, vector<char> &value, int minesPlaced, long long &nodes) {
+	if (--nodes < 0) return false;
+	
+	if (depth == component.vars.size()) {
+		component.count[minesPlaced] += 1;
+		
+		for (size_t i = 0; i < component.vars.size(); ++i) {
+			if (value[i]) {
+				component.mineCount[minesPlaced][i] += 1;
+			}
+		}
+		
+		return true;
+	}
+	
+	int v = component.vars[depth];
+	
+	for (int mine = 0; mine <= 1; ++mine) {
+		bool feasible = true;
+		
+		for (int c : model.varConstraints[v]) {
+			assigned[c] += mine;
+			unassigned[c]--;
+			
+			if (assigned[c] > model.constraintNeed[c] || assigned[c] + unassigned[c] < model.constraintNeed[c]) {
+				feasible = false;
+			}
+		}
+		
+		value[depth] = mine;
+		
+		if (feasible && !enumerateComponent(model, component, depth + 1, assigned, unassigned, value, minesPlaced + mine, nodes)) {
+			return false;
+		}
+		
+		for (int c : model.varConstraints[v]) {
+			assigned[c] -= mine;
+			unassigned[c]++;
+		}
+	}
+	
+	return true;
+}
+
+// 多项式卷积，结果按最大值归一化以避免溢出（概率只与相对大小有关）
+vector<double> convolve(const vector<double> &a, const vector<double> &b) {
+	vector<double> result(a.size() + b.size() - 1, 0.0);
+	double largest = 0;
+	
+	for (size_t i = 0; i < a.size(); ++i) {
+		for (size_t j = 0; j < b.size(); ++j) {
+			result[i + j] += a[i] * b[j];
+		}
+	}
+	
+	for (double value : result) {
+		largest = max(largest, value);
+	}
+	
+	if (largest > 0) {
+		for (double &value : result) {
+			value /= largest;
+		}
+	}
+	
+	return result;
+}
+
+// 布尔卷积：a、b 中可能出现的地雷数之和
+vector<char> convolveFeasible(const vector<char> &a, const vector<char> &b) {
+	vector<char> result(a.size() + b.size() - 1, 0);
+	
+	for (size_t i = 0; i < a.size(); ++i) {
+		for (size_t j = 0; j < b.size() && a[i]; ++j) {
+			result[i + j] |= b[j];
+		}
+	}
+	
+	return result;
+}
+
+// 精确计算约束模型中每个变量为地雷的概率。约束把变量分成互不相关的连通块，
+// 每块单独枚举，再结合剩余地雷在不受约束格子中的组合数 C(interiorCount, r) 合并。
+// certainty 不为空时另外给出每个变量是否确定（1 必为地雷，0 必定安全，-1 不确定），
+// interiorCertainty 为不受约束格子的确定性。确定性只按解是否存在判断，不受浮点精度影响。
+// 搜索节点超过 nodeLimit 或约束无解时返回 false
+bool solveExactProbabilities(const ConstraintModel &model, vector<double> &probability, double &interiorProbability, vector<signed char> *certainty = nullptr, signed char *interiorCertainty = nullptr, long long nodeLimit = EXACT_NODE_LIMIT) {
+	int n = model.cells.size();
+	int interior = model.interiorCount;
+	int minesLeft = model.minesLeft;
+	long long nodes = nodeLimit;
+	
+	// 用广度优先搜索划分连通块，同一块内的变量按发现顺序枚举，剪枝效果更好
+	vector<ComponentSolutions> components;
+	vector<int> componentOf(n, -1);
+	vector<int> assigned(model.constraintVars.size(), 0);
+	vector<int> unassigned(model.constraintVars.size());
+	
+	for (size_t c = 0; c < model.constraintVars.size(); ++c) {
+		unassigned[c] = model.constraintVars[c].size();
+	}
+	
+	for (int start = 0; start < n; ++start) {
+		if (componentOf[start] >= 0) continue;
+		
+		ComponentSolutions component;
+		componentOf[start] = components.size();
+		component.vars.push_back(start);
+		
+		for (size_t head = 0; head < component.vars.size(); ++head) {
+			for (int c : model.varConstraints[component.vars[head]]) {
+				for (int v : model.constraintVars[c]) {
+					if (componentOf[v] < 0) {
+						componentOf[v] = components.size();
+						component.vars.push_back(v);
+					}
+				}
+			}
+		}
+		
+		size_t size = component.vars.size();
+		component.count.assign(size + 1, 0.0);
+		component.mineCount.assign(size + 1, vector<double>(size, 0.0));
+		vector<char> value(size, 0);
+		
+		if (!enumerateComponent(model, component, 0, assigned, unassigned, value, 0, nodes)) return false;
+		
+		// 按最大值归一化，不影响概率
+		double largest = *max_element(component.count.begin(), component.count.end());
+		
+		if (largest == 0) return false; // 约束无解
+		
+		for (size_t k = 0; k <= size; ++k) {
+			component.count[k] /= largest;
+			
+			for (double &value : component.mineCount[k]) {
+				value /= largest;
+			}
+		}
+		
+		components.push_back(component);
+	}
+	
+	// 剩余 r 颗地雷放在不受约束格子中的组合数（对数形式后归一化）
+	vector<double> interiorWays(minesLeft + 1, 0.0);
+	double largestLog = -1e300;
+	
+	for (int r = 0; r <= minesLeft && r <= interior; ++r) {
+		largestLog = max(largestLog, lgamma(interior + 1.0) - lgamma(r + 1.0) - lgamma(interior - r + 1.0));
+	}
+	
+	for (int r = 0; r <= minesLeft && r <= interior; ++r) {
+		interiorWays[r] = exp(lgamma(interior + 1.0) - lgamma(r + 1.0) - lgamma(interior - r + 1.0) - largestLog);
+	}
+	
+	auto ways = [&](int r) {
+		return r < 0 || r > minesLeft ? 0.0 : interiorWays[r];
+	};
+	
+	// 前缀和后缀卷积，用于得到“除某一块外其余各块”的地雷数分布
+	size_t blocks = components.size();
+	vector<vector<double>> prefix(blocks + 1, vector<double>(1, 1.0));
+	vector<vector<double>> suffix(blocks + 1, vector<double>(1, 1.0));
+	
+	for (size_t c = 0; c < blocks; ++c) {
+		prefix[c + 1] = convolve(prefix[c], components[c].count);
+	}
+	
+	for (size_t c = blocks; c-- > 0;) {
+		suffix[c] = convolve(suffix[c + 1], components[c].count);
+	}
+	
+	probability.assign(n, 0.0);
+	
+	for (size_t c = 0; c < blocks; ++c) {
+		vector<double> others = convolve(prefix[c], suffix[c + 1]);
+		const ComponentSolutions &component = components[c];
+		double totalWeight = 0;
+		
+		for (size_t k = 0; k < component.count.size(); ++k) {
+			// 块内有 k 颗地雷时，其余各块和不受约束格子的组合数
+			double weight = 0;
+			
+			for (size_t r = 0; r < others.size(); ++r) {
+				weight += others[r] * ways(minesLeft - (int)k - (int)r);
+			}
+			
+			totalWeight += component.count[k] * weight;
+			
+			for (size_t i = 0; i < component.vars.size(); ++i) {
+				probability[component.vars[i]] += component.mineCount[k][i] * weight;
+			}
+		}
+		
+		if (totalWeight <= 0) return false; // 与剩余地雷数矛盾
+		
+		for (int v : component.vars) {
+			probability[v] /= totalWeight;
+		}
+	}
+	
+	// 不受约束的格子：剩余地雷数的期望除以格子数
+	double totalWeight = 0;
+	double expectedMines = 0;
+	
+	for (size_t r = 0; r < prefix[blocks].size(); ++r) {
+		double weight = prefix[blocks][r] * ways(minesLeft - (int)r);
+		totalWeight += weight;
+		expectedMines += weight * (minesLeft - (int)r);
+	}
+	
+	if (totalWeight <= 0) return false;
+	
+	interiorProbability = interior > 0 ? expectedMines / totalWeight / interior : 0.0;
+	
+	if (!certainty) return true;
+	
+	// 确定性：只考虑与剩余地雷数相容的块内地雷数 k
+	auto interiorFits = [&](int r) {
+		return r >= 0 && r <= interior;
+	};
+	vector<vector<char>> prefixFeasible(blocks + 1, vector<char>(1, 1));
+	vector<vector<char>> suffixFeasible(blocks + 1, vector<char>(1, 1));
+	vector<vector<char>> blockFeasible(blocks);
+	
+	for (size_t c = 0; c < blocks; ++c) {
+		for (double count : components[c].count) {
+			blockFeasible[c].push_back(count > 0);
+		}
+		
+		prefixFeasible[c + 1] = convolveFeasible(prefixFeasible[c], blockFeasible[c]);
+	}
+	
+	for (size_t c = blocks; c-- > 0;) {
+		suffixFeasible[c] = convolveFeasible(suffixFeasible[c + 1], blockFeasible[c]);
+	}
+	
+	certainty->assign(n, -1);
+	
+	for (size_t c = 0; c < blocks; ++c) {
+		vector<char> others = convolveFeasible(prefixFeasible[c], suffixFeasible[c + 1]);
+		const ComponentSolutions &component = components[c];
+		vector<char> canMine(component.vars.size(), 0), canBeSafe(component.vars.size(), 0);
+		
+		for (size_t k = 0; k < component.count.size(); ++k) {
+			if (component.count[k] <= 0) continue;
+			
+			bool fits = false;
+			
+			for (size_t r = 0; r < others.size() && !fits; ++r) {
+				fits = others[r] && interiorFits(minesLeft - (int)k - (int)r);
+			}
+			
+			if (!fits) continue;
+			
+			for (size_t i = 0; i < component.vars.size(); ++i) {
+				canMine[i] |= component.mineCount[k][i] > 0;
+				canBeSafe[i] |= component.mineCount[k][i] < component.count[k];
+			}
+		}
+		
+		for (size_t i = 0; i < component.vars.size(); ++i) {
+			(*certainty)[component.vars[i]] = canMine[i] && !canBeSafe[i] ? 1 : (!canMine[i] && canBeSafe[i] ? 0 : -1);
+		}
+	}
+	
+	if (interiorCertainty) {
+		bool canMine = false, canBeSafe = false;
+		
+		for (size_t r = 0; r < prefixFeasible[blocks].size(); ++r) {
+			int rest = minesLeft - (int)r;
+			
+			if (!prefixFeasible[blocks][r] || !interiorFits(rest)) continue;
+			
+			canMine |= rest > 0;
+			canBeSafe |= rest < interior;
+		}
+		
+		*interiorCertainty = canMine && !canBeSafe ? 1 : (!canMine && canBeSafe ? 0 : -1);
+	}
+	
+	return true;
+}
+
+// 热图过期时重新计算：优先用分析器的前沿做精确计算，前沿过于复杂时改用蒙特卡洛估计
+void refreshHeatmap() {
+	if (!heatmapActive) return;
+	
+	if (analyzer.stale) {
+		rebuildAnalyzer();
+	}
+	
+	if (heatmapVersion == analyzer.version) return;
+	
+	ConstraintModel model = buildFrontierModel();
+	vector<double> probability;
+	double interiorProbability = 0;
+	heatmap.assign(rows * cols, -1);
+	
+	if (solveExactProbabilities(model, probability, interiorProbability)) {
+		for (int i = 0; i < rows; ++i) {
+			for (int j = 0; j < cols; ++j) {
+				if (!revealed[i][j]) {
+					heatmap[i * cols + j] = interiorProbability;
+				}
+			}
+		}
+		
+		for (size_t v = 0; v < model.cells.size(); ++v) {
+			heatmap[model.cells[v]] = probability[v];
+		}
+	} else {
+		ProbabilityEstimate estimate = estimateMineProbabilities(buildConstraintModel(), HEATMAP_TIME_BUDGET_MS);
+		
+		for (int k = 0; k < rows * cols; ++k) {
+			heatmap[k] = estimate.cells[k].p;
+		}
+	}
+	
+	heatmapVersion = analyzer.version;
+	screenDirty = true; // 大部分未揭开格子的概率都会变化，整屏重绘
+}
+
+// 概率热图道具：本层剩余时间内在未揭开的格子上显示地雷概率
+void probabilityHeatmap() {
+	heatmapActive = true;
+	clearScreen();
+	cout << "概率热图道具已使用，未揭开的格子将显示其为地雷的概率（%）。" << endl;
+}
+
+// 将 0/1 数组按位打包，每字节 8 个格子，低位在前
+void packBits(const vector<char> &values, vector<unsigned char> &bits) {
+	bits.assign((values.size() + 7) / 8, 0);
+	
+	for (size_t k = 0; k < values.size(); ++k) {
+		if (values[k]) {
+			bits[k / 8] |= 1 << (k % 8);
+		}
+	}
+}
+
+// 读取按位打包的第 k 个格子
+bool testBit(const unsigned char *bits, size_t k) {
+	return (bits[k / 8] >> (k % 8)) & 1;
+}
+
+// 用给定的随机数生成器生成一个随机棋盘并计算数字（不使用全局状态，可在多个线程中调用）
+void generatePuzzleBoard(PuzzleBoard &puzzle, int rows, int cols, int mines, mt19937 &rng) {
+	puzzle.rows = rows;
+	puzzle.cols = cols;
+	puzzle.mines = mines;
+	puzzle.cells.assign(rows * cols, '0');
+	puzzle.revealed.assign(rows * cols, 0);
+	int placedMines = 0;
+	
+	while (placedMines < mines) {
+		int cell = rng() % (rows * cols);
+		
+		if (puzzle.cells[cell] != 'M') {
+			puzzle.cells[cell] = 'M';
+			placedMines++;
+		}
+	}
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (puzzle.cells[i * cols + j] == 'M') continue;
+			
+			int count = 0;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = i + dx;
+					int ny = j + dy;
+					
+					if (nx >= 0 && nx < rows && ny >= 0 && ny < cols && puzzle.cells[nx * cols + ny] == 'M') {
+						count++;
+					}
+				}
+			}
+			
+			puzzle.cells[i * cols + j] = '0' + count;
+		}
+	}
+}
+
+// 由残局的推理状态建立约束模型。known：0 未知，1 已揭开，2 已推出是地雷
+ConstraintModel buildPuzzleModel(const PuzzleBoard &puzzle, const vector<char> &known) {
+	int rows = puzzle.rows, cols = puzzle.cols;
+	ConstraintModel model;
+	vector<int> varOf(rows * cols, -1);
+	int unknown = 0, knownMines = 0;
+	
+	for (int cell = 0; cell < rows * cols; ++cell) {
+		if (known[cell] == 0) {
+			unknown++;
+		} else if (known[cell] == 2) {
+			knownMines++;
+		}
+	}
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (known[i * cols + j] != 1) continue;
+			
+			int need = puzzle.cells[i * cols + j] - '0';
+			vector<int> vars;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = i + dx;
+					int ny = j + dy;
+					
+					if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+					
+					int neighbour = nx * cols + ny;
+					
+					if (known[neighbour] == 2) {
+						need--;
+					} else if (known[neighbour] == 0) {
+						if (varOf[neighbour] < 0) {
+							varOf[neighbour] = model.cells.size();
+							model.cells.push_back(neighbour);
+							model.varConstraints.emplace_back();
+						}
+						
+						vars.push_back(varOf[neighbour]);
+					}
+				}
+			}
+			
+			if (vars.empty()) continue;
+			
+			for (int v : vars) {
+				model.varConstraints[v].push_back(model.constraintVars.size());
+			}
+			
+			model.constraintVars.push_back(vars);
+			model.constraintNeed.push_back(need);
+		}
+	}
+	
+	model.minesLeft = puzzle.mines - knownMines;
+	model.interiorCount = unknown - model.cells.size();
+	return model;
+}
+
+// 逻辑推理：从 known（0 未知，1 已揭开，2 已推出是地雷）出发反复推理，并更新 known 和剩余安全格子数 safeLeft。
+// 揭开了所有安全格子时返回 true，无法再推出任何格子时返回 false。
+// solverLevel 为 1 时只用单个数字推理，为 2 时还会对前沿做精确枚举（联合多个数字和剩余地雷数）
+bool deduceCells(const PuzzleBoard &puzzle, vector<char> &known, int &safeLeft, int solverLevel) {
+	int rows = puzzle.rows, cols = puzzle.cols;
+	
+	while (safeLeft > 0) {
+		bool progress = false;
+		
+		// 单个数字推理：剩余地雷数为 0 则邻居全部安全，等于未知邻居数则全部是地雷
+		for (int cell = 0; cell < rows * cols; ++cell) {
+			if (known[cell] != 1) continue;
+			
+			int x = cell / cols, y = cell % cols;
+			int need = puzzle.cells[cell] - '0';
+			int unknown = 0;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = x + dx, ny = y + dy;
+					
+					if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+					
+					if (known[nx * cols + ny] == 2) {
+						need--;
+					} else if (known[nx * cols + ny] == 0) {
+						unknown++;
+					}
+				}
+			}
+			
+			if (unknown == 0 || (need != 0 && need != unknown)) continue;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = x + dx, ny = y + dy;
+					
+					if (nx < 0 || nx >= rows || ny < 0 || ny >= cols || known[nx * cols + ny] != 0) continue;
+					
+					known[nx * cols + ny] = need == 0 ? 1 : 2;
+					safeLeft -= need == 0;
+				}
+			}
+			
+			progress = true;
+		}
+		
+		if (progress || solverLevel < 2) {
+			if (!progress) return false;
+			
+			continue;
+		}
+		
+		// 精确枚举：所有可能的解中都安全的格子一定安全，都是地雷的一定是地雷
+		ConstraintModel model = buildPuzzleModel(puzzle, known);
+		vector<double> probability;
+		vector<signed char> certainty;
+		double interiorProbability;
+		signed char interiorCertainty;
+		
+		if (!solveExactProbabilities(model, probability, interiorProbability, &certainty, &interiorCertainty, PUZZLE_NODE_LIMIT)) return false;
+		
+		for (size_t v = 0; v < model.cells.size(); ++v) {
+			if (certainty[v] >= 0) {
+				known[model.cells[v]] = certainty[v] == 0 ? 1 : 2;
+				safeLeft -= certainty[v] == 0;
+				progress = true;
+			}
+		}
+		
+		if (!progress && model.interiorCount > 0 && interiorCertainty >= 0) {
+			// 前沿已确定，剩余不受约束的格子全是地雷或全部安全
+			vector<char> isVariable(rows * cols, 0);
+			for (int cell : model.cells) isVariable[cell] = 1;
+			
+			for (int cell = 0; cell < rows * cols; ++cell) {
+				if (known[cell] == 0 && !isVariable[cell]) {
+					known[cell] = interiorCertainty == 0 ? 1 : 2;
+					safeLeft -= interiorCertainty == 0;
+				}
+			}
+			
+			progress = true;
+		}
+		
+		if (!progress) return false;
+	}
+	
+	return true;
+}
+
+// 逻辑求解器：从残局揭开的格子出发，能否只靠推理（不猜测）揭开所有安全格子
+bool solvableByLogic(const PuzzleBoard &puzzle, int solverLevel) {
+	vector<char> known(puzzle.rows * puzzle.cols, 0);
+	int safeLeft = 0;
+	
+	for (size_t cell = 0; cell < known.size(); ++cell) {
+		if (puzzle.revealed[cell]) {
+			known[cell] = 1;
+		} else if (puzzle.cells[cell] != 'M') {
+			safeLeft++;
+		}
+	}
+	
+	return deduceCells(puzzle, known, safeLeft, solverLevel);
+}
+
+// 按给定顺序尝试隐藏安全格子，隐藏后仍能用 solverLevel 的推理解开才保留，隐藏 target 个为止。
+// 返回按隐藏先后排列的格子，其中任意前缀都是隐藏过程中验证过可解的中间状态
+vector<int> hideResidualCells(PuzzleBoard &puzzle, const vector<int> &order, size_t target, int solverLevel) {
+	int rows = puzzle.rows, cols = puzzle.cols;
+	vector<int> hiddenCells;
+	
+	for (int cell : order) {
+		if (hiddenCells.size() >= target) break;
+		
+		// 揭开的 0 在正常游戏中会自动展开，所以它的邻居必须保持揭开
+		int x = cell / cols, y = cell % cols;
+		bool besideZero = false;
+		
+		for (int dx = -1; dx <= 1; ++dx) {
+			for (int dy = -1; dy <= 1; ++dy) {
+				int nx = x + dx, ny = y + dy;
+				
+				if (nx < 0 || nx >= rows || ny < 0 || ny >= cols) continue;
+				
+				if (puzzle.revealed[nx * cols + ny] && puzzle.cells[nx * cols + ny] == '0') besideZero = true;
+			}
+		}
+		
+		if (besideZero) continue;
+		
+		puzzle.revealed[cell] = 0;
+		
+		if (solvableByLogic(puzzle, solverLevel)) {
+			hiddenCells.push_back(cell);
+		} else {
+			puzzle.revealed[cell] = 1;
+		}
+	}
+	
+	return hiddenCells;
+}
+
+// 生成一个残局：从揭开全部安全格子开始，按随机顺序尝试隐藏安全格子，隐藏后仍能只靠逻辑推理解开才保留。
+// 难度 1 只用单格推理，隐藏到安全格子的目标比例为止。难度 2、3 用联合推理隐藏所有能隐藏的格子，
+// 难度 3 全部保留；难度 2 只保留最先隐藏的一部分（至少一格，至少比难度 3 少一格），这是隐藏过程中验证过可解的中间状态，
+// 所以同一棋盘上难度 3 隐藏的格子总是严格多于难度 2。
+// 一个格子都没能隐藏，或者难度 2、3 的结果只靠单格推理就能解开时，换下一块棋盘重试。
+// 棋盘都取自同一个随机数序列，同一个种子总是得到同一个残局；连续 RESIDUAL_MAX_ATTEMPTS 块都不合格时
+// （棋盘太小或地雷太密）保留最后一次的结果
+void generateResidualPuzzle(PuzzleBoard &puzzle, int rows, int cols, int mines, int difficulty, unsigned seed) {
+	mt19937 rng(seed);
+	
+	for (int attempt = 0; attempt < RESIDUAL_MAX_ATTEMPTS; ++attempt) {
+		generatePuzzleBoard(puzzle, rows, cols, mines, rng);
+		vector<int> safeCells;
+		
+		for (int cell = 0; cell < rows * cols; ++cell) {
+			if (puzzle.cells[cell] != 'M') {
+				puzzle.revealed[cell] = 1;
+				safeCells.push_back(cell);
+			}
+		}
+		
+		shuffle(safeCells.begin(), safeCells.end(), rng);
+		
+		if (difficulty == 1) {
+			size_t target = max((size_t)1, (size_t)(safeCells.size() * RESIDUAL_HIDE_RATIO[1]));
+			
+			if (!hideResidualCells(puzzle, safeCells, target, 1).empty()) return;
+			
+			continue;
+		}
+		
+		vector<int> hiddenCells = hideResidualCells(puzzle, safeCells, safeCells.size(), 2);
+		
+		if (hiddenCells.size() < 2) continue; // 难度 2 和 3 无法拉开差距
+		
+		size_t kept = hiddenCells.size();
+		
+		if (difficulty == 2) {
+			kept = min(hiddenCells.size() - 1, max((size_t)1, (size_t)(hiddenCells.size() * RESIDUAL_HIDE_RATIO[2])));
+		}
+		
+		for (size_t k = kept; k < hiddenCells.size(); ++k) {
+			puzzle.revealed[hiddenCells[k]] = 1;
+		}
+		
+		if (!solvableByLogic(puzzle, 1)) return;
+	}
+}
+
+// 在残局库中二分查找指定棋盘和难度的残局，返回 [first, last) 范围
+pair<const ResidualPoolEntry *, const ResidualPoolEntry *> findResidualPuzzles(int rows, int cols, int mines, int difficulty) {
+	if (!residualPoolOpened) {
+		residualPoolOpened = true;
+		
+		if (!residualPool.open(RESIDUAL_POOL_FILE)) {
+			return {nullptr, nullptr};
+		}
+	}
+	
+	const unsigned char *data = residualPool.data();
+	
+	if (!data || residualPool.size() < sizeof(ResidualPoolHeader)) return {nullptr, nullptr};
+	
+	const ResidualPoolHeader *header = (const ResidualPoolHeader *)data;
+	
+	if (memcmp(header->magic, RESIDUAL_POOL_MAGIC, 8) != 0 || residualPool.size() < sizeof(ResidualPoolHeader) + header->count * sizeof(ResidualPoolEntry)) {
+		return {nullptr, nullptr};
+	}
+	
+	const ResidualPoolEntry *entries = (const ResidualPoolEntry *)(data + sizeof(ResidualPoolHeader));
+	auto key = make_tuple(rows, cols, mines, difficulty);
+	auto less = [](const ResidualPoolEntry &entry, const tuple<int, int, int, int> &value) {
+		return make_tuple((int)entry.rows, (int)entry.cols, (int)entry.mines, (int)entry.difficulty) < value;
+	};
+	auto greater = [](const tuple<int, int, int, int> &value, const ResidualPoolEntry &entry) {
+		return value < make_tuple((int)entry.rows, (int)entry.cols, (int)entry.mines, (int)entry.difficulty);
+	};
+	const ResidualPoolEntry *first = lower_bound(entries, entries + header->count, key, less);
+	const ResidualPoolEntry *last = upper_bound(first, entries + header->count, key, greater);
+	return {first, last};
+}
+
+// 开始残局：从映射的残局库中随机取出一个匹配的残局；库中没有时当场生成
+void loadResidualPuzzle() {
+	auto range = findResidualPuzzles(rows, cols, mines, residualDifficulty);
+	int total = rows * cols;
+	
+	const ResidualPoolEntry *entry = nullptr;
+	
+	if (range.first != range.second) {
+		entry = &range.first[rand() % (range.second - range.first)];
+		
+		// 位图超出文件范围（文件损坏或被截断）时改为当场生成
+		if (entry->offset > residualPool.size() || residualPool.size() - entry->offset < 2 * ((size_t)(total + 7) / 8)) {
+			entry = nullptr;
+		}
+	}
+	
+	if (entry) {
+		const unsigned char *mineBits = residualPool.data() + entry->offset;
+		boardSeed = entry->seed;
+		const unsigned char *revealedBits = mineBits + (total + 7) / 8;
+		
+		for (int cell = 0; cell < total; ++cell) {
+			if (testBit(mineBits, cell)) {
+				board[cell / cols][cell % cols] = 'M';
+			}
+		}
+		
+		calculateNumbers();
+		
+		for (int cell = 0; cell < total; ++cell) {
+			if (testBit(revealedBits, cell)) {
+				revealed[cell / cols][cell % cols] = true;
+				revealedCount++;
+			}
+		}
+	} else {
+		clearScreen();
+		cout << "残局库中没有该棋盘的残局，正在生成..." << endl;
+		PuzzleBoard puzzle;
+		boardSeed = random_device()();
+		generateResidualPuzzle(puzzle, rows, cols, mines, residualDifficulty, boardSeed);
+		
+		for (int cell = 0; cell < total; ++cell) {
+			board[cell / cols][cell % cols] = puzzle.cells[cell];
+			
+			if (puzzle.revealed[cell]) {
+				revealed[cell / cols][cell % cols] = true;
+				revealedCount++;
+			}
+		}
+	}
+	
+	indexMines();
+}
+
+// 离线生成残局库：--generate-residual <文件> <每种棋盘每个难度的数量> [行x列x地雷 ...]
+// 不指定棋盘时生成简单、中等、困难三种预设棋盘，所有残局在多个线程中并行生成
+int generateResidualPool(int argc, char *argv[]) {
+	if (argc < 4) {
+		cout << "用法: " << argv[0] << " --generate-residual <文件> <数量> [行x列x地雷 ...]" << endl;
+		return 1;
+	}
+	
+	string path = argv[2];
+	int perConfig = atoi(argv[3]);
+	vector<tuple<int, int, int>> configs;
+	
+	for (int i = 4; i < argc; ++i) {
+		int r, c, m;
+		
+		// 索引表中行、列和地雷数都是 16 位整数
+		if (sscanf(argv[i], "%dx%dx%d", &r, &c, &m) != 3 || r <= 0 || c <= 0 || m <= 0 || r > 65535 || c > 65535 || m > 65535 || m >= (long long)r * c) {
+			cout << "无效的棋盘: " << argv[i] << endl;
+			return 1;
+		}
+		
+		configs.push_back(make_tuple(r, c, m));
+	}
+	
+	if (configs.empty()) {
+		configs = {make_tuple(EASY, EASY, 5), make_tuple(MEDIUM, MEDIUM, 20), make_tuple(HARD, HARD, 99)};
+	}
+	
+	// 任务列表已按（行, 列, 地雷, 难度）排好序，写出的索引表可以直接二分查找
+	sort(configs.begin(), configs.end());
+	vector<ResidualPoolEntry> entries;
+	
+	for (const auto &config : configs) {
+		for (int difficulty = 1; difficulty <= RESIDUAL_LEVELS; ++difficulty) {
+			for (int k = 0; k < perConfig; ++k) {
+				ResidualPoolEntry entry = {};
+				entry.rows = get<0>(config);
+				entry.cols = get<1>(config);
+				entry.mines = get<2>(config);
+				entry.difficulty = difficulty;
+				entries.push_back(entry);
+			}
+		}
+	}
+	
+	vector<PuzzleBoard> puzzles(entries.size());
+	atomic<size_t> next(0);
+	atomic<size_t> done(0);
+	random_device seeder;
+	
+	for (auto &entry : entries) {
+		entry.seed = seeder();
+	}
+	
+	auto worker = [&]() {
+		for (size_t k = next++; k < entries.size(); k = next++) {
+			const ResidualPoolEntry &entry = entries[k];
+			generateResidualPuzzle(puzzles[k], entry.rows, entry.cols, entry.mines, entry.difficulty, entry.seed);
+			done++;
+		}
+	};
+	
+	int threadCount = max(1u, thread::hardware_concurrency());
+	vector<thread> workers;
+	auto begin = chrono::steady_clock::now();
+	
+	for (int t = 0; t < threadCount; ++t) {
+		workers.emplace_back(worker);
+	}
+	
+	for (auto &thread : workers) {
+		thread.join();
+	}
+	
+	// 写出文件头、索引表和位图
+	ofstream file(path, ios::binary);
+	
+	if (!file.is_open()) {
+		cout << "无法写入残局库: " << path << endl;
+		return 1;
+	}
+	
+	ResidualPoolHeader header = {};
+	memcpy(header.magic, RESIDUAL_POOL_MAGIC, 8);
+	header.count = entries.size();
+	header.version = 1;
+	uint32_t offset = sizeof(ResidualPoolHeader) + entries.size() * sizeof(ResidualPoolEntry);
+	
+	for (size_t k = 0; k < entries.size(); ++k) {
+		entries[k].offset = offset;
+		offset += 2 * ((puzzles[k].cells.size() + 7) / 8);
+	}
+	
+	file.write((const char *)&header, sizeof(header));
+	file.write((const char *)entries.data(), entries.size() * sizeof(ResidualPoolEntry));
+	
+	for (const auto &puzzle : puzzles) {
+		vector<char> mineCells(puzzle.cells.size());
+		vector<unsigned char> bits;
+		
+		for (size_t cell = 0; cell < puzzle.cells.size(); ++cell) {
+			mineCells[cell] = puzzle.cells[cell] == 'M';
+		}
+		
+		packBits(mineCells, bits);
+		file.write((const char *)bits.data(), bits.size());
+		packBits(puzzle.revealed, bits);
+		file.write((const char *)bits.data(), bits.size());
+	}
+	
+	auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin).count();
+	cout << "已生成 " << done << " 个残局（" << threadCount << " 线程，" << elapsed << " 毫秒），写入 " << path << endl;
+	return 0;
+}
+
+// 棋盘缓存中预设的队列：简单、中等、困难三种棋盘，每种棋盘一个经典队列和每个残局难度一个队列
+vector<BoardCacheRing> boardCacheLayout() {
+	const int presets[3][3] = {{EASY, EASY, 5}, {MEDIUM, MEDIUM, 20}, {HARD, HARD, 99}};
+	size_t ringCount = 3 * (RESIDUAL_LEVELS + 1);
+	uint32_t offset = sizeof(BoardCacheHeader) + ringCount * sizeof(BoardCacheRing);
+	vector<BoardCacheRing> rings;
+	
+	for (const auto &preset : presets) {
+		for (int difficulty = 0; difficulty <= RESIDUAL_LEVELS; ++difficulty) {
+			BoardCacheRing ring = {};
+			ring.rows = preset[0];
+			ring.cols = preset[1];
+			ring.mines = preset[2];
+			ring.difficulty = difficulty;
+			ring.slotSize = (sizeof(uint32_t) + 2 * ((preset[0] * preset[1] + 7) / 8) + 3) / 4 * 4;
+			ring.offset = offset;
+			offset += ring.slotSize * BOARD_CACHE_CAPACITY;
+			rings.push_back(ring);
+		}
+	}
+	
+	return rings;
+}
+
+const BoardCacheHeader *boardCacheHeader() {
+	return (const BoardCacheHeader *)boardCacheData;
+}
+
+BoardCacheRing *boardCacheRings() {
+	return (BoardCacheRing *)(boardCacheData + sizeof(BoardCacheHeader));
+}
+
+// 检查映射的缓存文件是否与当前布局一致、队列计数是否有效
+bool boardCacheValid(const vector<BoardCacheRing> &layout) {
+	const BoardCacheHeader *header = boardCacheHeader();
+	
+	if (memcmp(header->magic, BOARD_CACHE_MAGIC, 8) != 0 || header->ringCount != layout.size() || header->capacity != BOARD_CACHE_CAPACITY) {
+		return false;
+	}
+	
+	for (size_t k = 0; k < layout.size(); ++k) {
+		const BoardCacheRing &ring = boardCacheRings()[k];
+		
+		if (ring.rows != layout[k].rows || ring.cols != layout[k].cols || ring.mines != layout[k].mines || ring.difficulty != layout[k].difficulty
+		        || ring.slotSize != layout[k].slotSize || ring.offset != layout[k].offset || ring.tail - ring.head > BOARD_CACHE_CAPACITY) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// 打开棋盘缓存文件：独占锁定后映射到内存，上次运行留下的棋盘可以直接使用。
+// 文件被其他进程占用或无法映射时，缓存只保存在本进程的内存中
+void openBoardCache() {
+	vector<BoardCacheRing> layout = boardCacheLayout();
+	boardCacheSize = layout.back().offset + layout.back().slotSize * BOARD_CACHE_CAPACITY;
+#ifndef _WIN32
+	int fd = ::open(BOARD_CACHE_FILE.c_str(), O_RDWR | O_CREAT, 0644);
+	
+	if (fd >= 0) {
+		struct stat info;
+		bool sized = fstat(fd, &info) == 0 && (size_t)info.st_size == boardCacheSize;
+		
+		if (flock(fd, LOCK_EX | LOCK_NB) == 0 && (sized || ftruncate(fd, boardCacheSize) == 0)) {
+			void *mapped = mmap(nullptr, boardCacheSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			
+			if (mapped != MAP_FAILED) {
+				boardCacheData = (unsigned char *)mapped;
+				boardCacheMapped = true;
+			}
+		}
+		
+		// 映射成功时保持文件描述符打开，锁一直持有到进程退出
+		if (!boardCacheMapped) close(fd);
+	}
+#endif
+	
+	if (!boardCacheMapped) {
+		boardCacheMemory.assign(boardCacheSize, 0);
+		boardCacheData = boardCacheMemory.data();
+	} else if (boardCacheValid(layout)) {
+		return;
+	}
+	
+	// 新建的缓存或布局不一致：重新写入文件头和空队列
+	BoardCacheHeader header = {};
+	memcpy(header.magic, BOARD_CACHE_MAGIC, 8);
+	header.ringCount = layout.size();
+	header.capacity = BOARD_CACHE_CAPACITY;
+	memcpy(boardCacheData, &header, sizeof(header));
+	memcpy(boardCacheRings(), layout.data(), layout.size() * sizeof(BoardCacheRing));
+}
+
+// 后台补充线程：有队列少于 BOARD_CACHE_LOW_WATER 个棋盘时开始补充，每次给最空的队列生成一个棋盘，
+// 直到所有队列补满后再次等待
+void boardCacheWorker() {
+	random_device seeder;
+	BoardCacheRing *rings = boardCacheRings();
+	size_t ringCount = boardCacheHeader()->ringCount;
+	bool refilling = true; // 启动时先补满上次运行用掉的棋盘
+	unique_lock<mutex> lock(boardCacheMutex);
+	
+	while (!boardCacheStopping) {
+		size_t target = ringCount;
+		
+		for (size_t k = 0; k < ringCount; ++k) {
+			uint32_t count = rings[k].tail - rings[k].head;
+			
+			if (count < BOARD_CACHE_LOW_WATER) {
+				refilling = true;
+			}
+			
+			if (count < BOARD_CACHE_CAPACITY && (target == ringCount || count < rings[target].tail - rings[target].head)) {
+				target = k;
+			}
+		}
+		
+		if (target == ringCount) {
+			refilling = false;
+		}
+		
+		if (!refilling) {
+			boardCacheWake.wait(lock);
+			continue;
+		}
+		
+		// 生成时不持有锁，开局时仍可从队首取棋盘；tail 处的槽位只有本线程会写入
+		BoardCacheRing ring = rings[target];
+		unsigned seed = seeder();
+		lock.unlock();
+		auto begin = chrono::steady_clock::now();
+		PuzzleBoard puzzle;
+		
+		if (ring.difficulty == 0) {
+			mt19937 rng(seed);
+			generatePuzzleBoard(puzzle, ring.rows, ring.cols, ring.mines, rng);
+		} else {
+			generateResidualPuzzle(puzzle, ring.rows, ring.cols, ring.mines, ring.difficulty, seed);
+		}
+		
+		vector<char> mineCells(puzzle.cells.size());
+		vector<unsigned char> mineBits, revealedBits;
+		
+		for (size_t cell = 0; cell < puzzle.cells.size(); ++cell) {
+			mineCells[cell] = puzzle.cells[cell] == 'M';
+		}
+		
+		packBits(mineCells, mineBits);
+		packBits(puzzle.revealed, revealedBits);
+		uint32_t storedSeed = seed;
+		unsigned char *slot = boardCacheData + ring.offset + (ring.tail % BOARD_CACHE_CAPACITY) * ring.slotSize;
+		memcpy(slot, &storedSeed, sizeof(storedSeed));
+		memcpy(slot + sizeof(storedSeed), mineBits.data(), mineBits.size());
+		memcpy(slot + sizeof(storedSeed) + mineBits.size(), revealedBits.data(), revealedBits.size());
+		double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+		lock.lock();
+		rings[target].tail++;
+		boardCacheProduced++;
+		boardCacheProduceMs += elapsed;
+	}
+}
+
+// 打开棋盘缓存并启动后台补充线程
+void startBoardCache() {
+	openBoardCache();
+	boardCacheProducer = thread(boardCacheWorker);
+}
+
+// 停止后台补充线程，正在生成的棋盘会先写完
+void stopBoardCache() {
+	if (!boardCacheProducer.joinable()) return;
+	
+	{
+		lock_guard<mutex> lock(boardCacheMutex);
+		boardCacheStopping = true;
+	}
+	
+	boardCacheWake.notify_all();
+	boardCacheProducer.join();
+}
+
+// 从缓存中取出当前棋盘大小和模式对应的棋盘（O(1)）。
+// 自定义棋盘没有缓存队列，返回 false 且不计入命中率；队列为空时记为未命中并唤醒后台线程
+bool popCachedBoard() {
+	if (!boardCacheData) return false;
+	
+	int difficulty = gameMode == "残局模式" ? residualDifficulty : 0;
+	int total = rows * cols;
+	unique_lock<mutex> lock(boardCacheMutex);
+	BoardCacheRing *rings = boardCacheRings();
+	BoardCacheRing *ring = nullptr;
+	
+	for (size_t k = 0; k < boardCacheHeader()->ringCount; ++k) {
+		if (rings[k].rows == rows && rings[k].cols == cols && rings[k].mines == mines && rings[k].difficulty == difficulty) {
+			ring = &rings[k];
+			break;
+		}
+	}
+	
+	if (!ring) return false;
+	
+	if (ring->head == ring->tail) {
+		boardCacheMisses++;
+		lock.unlock();
+		boardCacheWake.notify_one();
+		return false;
+	}
+	
+	const unsigned char *slot = boardCacheData + ring->offset + (ring->head % BOARD_CACHE_CAPACITY) * ring->slotSize;
+	const unsigned char *mineBits = slot + sizeof(uint32_t);
+	memcpy(&boardSeed, slot, sizeof(boardSeed));
+	const unsigned char *revealedBits = mineBits + (total + 7) / 8;
+	
+	for (int cell = 0; cell < total; ++cell) {
+		if (testBit(mineBits, cell)) {
+			board[cell / cols][cell % cols] = 'M';
+		}
+		
+		if (testBit(revealedBits, cell)) {
+			revealed[cell / cols][cell % cols] = true;
+			revealedCount++;
+		}
+	}
+	
+	ring->head++;
+	boardCacheHits++;
+	bool low = ring->tail - ring->head < BOARD_CACHE_LOW_WATER;
+	lock.unlock();
+	
+	if (low) {
+		boardCacheWake.notify_one();
+	}
+	
+	calculateNumbers();
+	indexMines();
+	return true;
+}
+
+// 显示棋盘缓存统计：本次运行的命中率、后台补充的吞吐量和每个队列中剩余的棋盘数
+void showBoardCacheStats() {
+	clearScreen();
+	
+	{
+		lock_guard<mutex> lock(boardCacheMutex);
+		long long requests = boardCacheHits + boardCacheMisses;
+		cout << "棋盘缓存（" << (boardCacheMapped ? BOARD_CACHE_FILE : "仅内存") << "）:" << endl;
+		cout << "命中 " << boardCacheHits << " 次，未命中 " << boardCacheMisses << " 次，命中率 ";
+		
+		if (requests > 0) {
+			cout << fixed << setprecision(1) << 100.0 * boardCacheHits / requests << "%" << endl;
+		} else {
+			cout << "-" << endl;
+		}
+		
+		cout << "后台补充 " << boardCacheProduced << " 个棋盘";
+		
+		if (boardCacheProduced > 0) {
+			cout << "，平均 " << fixed << setprecision(2) << boardCacheProduceMs / boardCacheProduced << " 毫秒/个，吞吐量 "
+			     << setprecision(1) << boardCacheProduced * 1000.0 / max(boardCacheProduceMs, 1e-3) << " 个/秒";
+		}
+		
+		cout << endl << "剩余棋盘:" << endl;
+		const BoardCacheRing *rings = boardCacheRings();
+		
+		for (size_t k = 0; k < boardCacheHeader()->ringCount; ++k) {
+			const BoardCacheRing &ring = rings[k];
+			
+			if (ring.difficulty == 0) {
+				cout << ring.rows << "x" << ring.cols << " " << ring.mines << " 雷: 经典 ";
+			} else {
+				cout << ", 残局难度" << (int)ring.difficulty << " ";
+			}
+			
+			cout << ring.tail - ring.head << "/" << BOARD_CACHE_CAPACITY;
+			
+			if (ring.difficulty == RESIDUAL_LEVELS) {
+				cout << endl;
+			}
+		}
+		
+		cout << defaultfloat << setprecision(6);
+	}
+	
+	char choice;
+	
+	while (true) {
+		cout << "输入 'm' 返回菜单: ";
+		cin >> choice;
+		
+		if (cin.fail()) {
+			handleInvalidInput();
+			continue;
+		}
+		
+		if (choice == 'm') {
+			clearScreen();
+			showMenu();
+			break;
+		} else {
+			clearScreen();
+			cout << "无效选择。请重新输入。" << endl;
+		}
+	}
+}
+
+// 写出一条棋盘记录。bitAt(plane, cell) 给出格子 cell 在位平面 plane 上的值；
+// 编码为 BOARD_ENCODING_AUTO 时先空跑一遍估算 RLE 编码的大小，比原始编码小才使用 RLE
+template <typename BitSource>
+void writeBoardRecord(ostream &out, BoardRecordHeader header, BitSource bitAt) {
+	const uint8_t planeList[3] = {BOARD_PLANE_MINES, BOARD_PLANE_REVEALED, BOARD_PLANE_FLAGS};
+	size_t total = (size_t)header.rows * header.cols;
+	header.planes |= BOARD_PLANE_MINES;
+	
+	if (header.encoding == BOARD_ENCODING_AUTO) {
+		size_t rleBytes = 0, rawBytes = 0;
+		
+		for (uint8_t plane : planeList) {
+			if (!(header.planes & plane)) continue;
+			
+			PlaneWriter counter(nullptr, true);
+			
+			for (size_t cell = 0; cell < total; ++cell) {
+				counter.put(bitAt(plane, cell));
+			}
+			
+			counter.finish();
+			rleBytes += counter.bytes();
+			rawBytes += (total + 7) / 8;
+		}
+		
+		header.encoding = rleBytes < rawBytes ? BOARD_ENCODING_RLE : BOARD_ENCODING_RAW;
+	}
+	
+	out.write((const char *)&header, sizeof(header));
+	
+	for (uint8_t plane : planeList) {
+		if (!(header.planes & plane)) continue;
+		
+		PlaneWriter writer(&out, header.encoding == BOARD_ENCODING_RLE);
+		
+		for (size_t cell = 0; cell < total; ++cell) {
+			writer.put(bitAt(plane, cell));
+		}
+		
+		writer.finish();
+	}
+}
+
+// 读取一条记录的全部位平面，每读出一格调用 onBit(plane, cell, bit)；onBit 为空时只跳过这条记录
+template <typename BitSink>
+bool readBoardPlanes(istream &in, const BoardRecordHeader &header, BitSink onBit) {
+	const uint8_t planeList[3] = {BOARD_PLANE_MINES, BOARD_PLANE_REVEALED, BOARD_PLANE_FLAGS};
+	size_t total = (size_t)header.rows * header.cols;
+	
+	for (uint8_t plane : planeList) {
+		if (!(header.planes & plane)) continue;
+		
+		PlaneReader reader(in, header.encoding == BOARD_ENCODING_RLE);
+		bool bit;
+		
+		for (size_t cell = 0; cell < total; ++cell) {
+			if (!reader.get(bit)) return false;
+			
+			onBit(plane, cell, bit);
+		}
+		
+		if (!reader.finish()) return false;
+	}
+	
+	return true;
+}
+
+// 读取并检查一条记录头，文件结束或记录无效时返回 false
+bool readBoardHeader(istream &in, BoardRecordHeader &header) {
+	if (!in.read((char *)&header, sizeof(header))) return false;
+	
+	long long total = (long long)header.rows * header.cols;
+	return header.rows > 0 && header.cols > 0 && total <= MAX_BOARD_CELLS && header.mines < total && (header.planes & BOARD_PLANE_MINES)
+	       && (header.encoding == BOARD_ENCODING_RAW || header.encoding == BOARD_ENCODING_RLE);
+}
+
+// 打开棋盘文件并跳到第 index 条记录，读出它的记录头；之后从 file 中继续读取这条记录的位平面
+bool openBoardRecord(ifstream &file, const string &path, int index, BoardRecordHeader &header) {
+	file.open(path, ios::binary);
+	char magic[8];
+	
+	if (!file.is_open() || !file.read(magic, 8) || memcmp(magic, BOARD_FILE_MAGIC, 8) != 0) return false;
+	
+	for (int k = 0; k < index; ++k) {
+		if (!readBoardHeader(file, header) || !readBoardPlanes(file, header, [](uint8_t, size_t, bool) {})) return false;
+	}
+	
+	return readBoardHeader(file, header);
+}
+
+// 开局时读取 --board 指定的棋盘大小和地雷数，代替选择难度
+bool readBoardFileSize() {
+	ifstream file;
+	BoardRecordHeader header;
+	
+	if (!openBoardRecord(file, boardFile, boardFileIndex, header)) {
+		clearScreen();
+		cout << "无法读取棋盘文件 " << boardFile << " 的第 " << boardFileIndex << " 条记录，改为选择难度。" << endl;
+		boardFile.clear();
+		return false;
+	}
+	
+	rows = header.rows;
+	cols = header.cols;
+	mines = header.mines;
+	gameDifficulty = "自定义";
+	return true;
+}
+
+// 从 --board 指定的文件布置棋盘：位平面边读边写入棋盘，可选的揭开和标记平面一并恢复
+bool loadBoardFile() {
+	ifstream file;
+	BoardRecordHeader header;
+	
+	if (!openBoardRecord(file, boardFile, boardFileIndex, header) || header.rows != rows || header.cols != cols) return false;
+	
+	int placedMines = 0;
+	bool valid = readBoardPlanes(file, header, [&](uint8_t plane, size_t cell, bool bit) {
+		int x = cell / cols, y = cell % cols;
+		
+		if (!bit) return;
+		
+		if (plane == BOARD_PLANE_MINES) {
+			board[x][y] = 'M';
+			placedMines++;
+		} else if (plane == BOARD_PLANE_REVEALED) {
+			revealed[x][y] = true;
+		} else {
+			flagged[x][y] = true;
+			flagCount++;
+		}
+	});
+	
+	if (!valid || placedMines != mines) return false;
+	
+	calculateNumbers();
+	
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			if (revealed[i][j] && board[i][j] != 'M') {
+				revealedCount++;
+			}
+		}
+	}
+	
+	boardSeed = header.seed;
+	boardFromFile = true;
+	indexMines();
+	return true;
+}
+
+// 导出当前棋盘（包括揭开和标记状态），编码自动选择
+bool exportBoard(const string &path) {
+	ofstream file(path, ios::binary);
+	
+	if (!file.is_open()) return false;
+	
+	BoardRecordHeader header = {};
+	header.rows = rows;
+	header.cols = cols;
+	header.mines = mines;
+	header.seed = boardSeed;
+	header.planes = BOARD_PLANE_MINES | BOARD_PLANE_REVEALED | BOARD_PLANE_FLAGS;
+	header.encoding = BOARD_ENCODING_AUTO;
+	file.write(BOARD_FILE_MAGIC, 8);
+	writeBoardRecord(file, header, [](uint8_t plane, size_t cell) {
+		int x = cell / cols, y = cell % cols;
+		return plane == BOARD_PLANE_MINES ? board[x][y] == 'M' : (plane == BOARD_PLANE_REVEALED ? revealed[x][y] : flagged[x][y]);
+	});
+	return (bool)file;
+}
+
+// 生成棋盘语料库：--write-corpus <文件> <数量> <行x列x地雷> [--rle]
+// 棋盘逐个生成、逐个写出，内存占用与数量无关
+int writeBoardCorpus(int argc, char *argv[]) {
+	int r, c, m;
+	
+	if (argc < 5 || sscanf(argv[4], "%dx%dx%d", &r, &c, &m) != 3 || r <= 0 || c <= 0 || m < 0 || r > 65535 || c > 65535
+	    || (long long)r * c > MAX_BOARD_CELLS || m >= (long long)r * c) {
+		cout << "用法: " << argv[0] << " --write-corpus <文件> <数量> <行x列x地雷> [--rle]" << endl;
+		return 1;
+	}
+	
+	string path = argv[2];
+	long long count = atoll(argv[3]);
+	bool rle = argc >= 6 && string(argv[5]) == "--rle";
+	ofstream file(path, ios::binary);
+	
+	if (!file.is_open()) {
+		cout << "无法写入语料库: " << path << endl;
+		return 1;
+	}
+	
+	vector<char> buffer(1 << 20); // 加大写缓冲区，减少系统调用
+	file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+	file.write(BOARD_FILE_MAGIC, 8);
+	random_device seeder;
+	mt19937 seeds(seeder());
+	PuzzleBoard puzzle;
+	auto begin = chrono::steady_clock::now();
+	
+	for (long long k = 0; k < count; ++k) {
+		BoardRecordHeader header = {};
+		header.rows = r;
+		header.cols = c;
+		header.mines = m;
+		header.seed = seeds();
+		header.planes = BOARD_PLANE_MINES;
+		header.encoding = rle ? BOARD_ENCODING_RLE : BOARD_ENCODING_RAW;
+		mt19937 rng(header.seed);
+		generatePuzzleBoard(puzzle, r, c, m, rng);
+		writeBoardRecord(file, header, [&](uint8_t, size_t cell) {
+			return puzzle.cells[cell] == 'M';
+		});
+	}
+	
+	file.close();
+	
+	if (!file) {
+		cout << "写入语料库失败: " << path << endl;
+		return 1;
+	}
+	
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	cout << "已写入 " << count << " 个 " << r << "x" << c << " 棋盘（" << m << " 颗地雷，" << (rle ? "RLE" : "原始") << "编码），用时 "
+	     << fixed << setprecision(2) << seconds << " 秒，" << setprecision(0) << count / max(seconds, 1e-9) << " 个/秒" << endl;
+	return 0;
+}
+
+// 计算 3BV：每片相连的 0 区域（连同它边界上的数字）算一次点击，其余不与 0 相邻的安全格子各算一次。
+// 开局时已揭开的格子（残局）不计入
+int countBBBV(const PuzzleBoard &puzzle) {
+	int rows = puzzle.rows, cols = puzzle.cols;
+	vector<char> opened(rows * cols, 0);
+	vector<int> stack;
+	int bbbv = 0;
+	
+	for (int start = 0; start < rows * cols; ++start) {
+		if (puzzle.cells[start] != '0' || opened[start] || puzzle.revealed[start]) continue;
+		
+		bbbv++;
+		opened[start] = 1;
+		stack.push_back(start);
+		
+		while (!stack.empty()) {
+			int cell = stack.back();
+			stack.pop_back();
+			int x = cell / cols, y = cell % cols;
+			
+			for (int dx = -1; dx <= 1; ++dx) {
+				for (int dy = -1; dy <= 1; ++dy) {
+					int nx = x + dx, ny = y + dy;
+					
+					if (nx < 0 || nx >= rows || ny < 0 || ny >= cols || opened[nx * cols + ny]) continue;
+					
+					opened[nx * cols + ny] = 1;
+					
+					if (puzzle.cells[nx * cols + ny] == '0') {
+						stack.push_back(nx * cols + ny);
+					}
+				}
+			}
+		}
+	}
+	
+	for (int cell = 0; cell < rows * cols; ++cell) {
+		if (puzzle.cells[cell] != 'M' && !opened[cell] && !puzzle.revealed[cell]) {
+			bbbv++;
+		}
+	}
+	
+	return bbbv;
+}
+
+// 评估候选棋盘的难度：用逻辑推理求解，卡住时猜测地雷概率最小的格子（第一次点击也是猜测），
+// 记录猜测次数和全部猜对的概率，再按 3BV 和猜测次数估算预计用时
+void scoreLadderCandidate(LevelCandidate &candidate) {
+	const PuzzleBoard &puzzle = candidate.puzzle;
+	int total = puzzle.rows * puzzle.cols;
+	vector<char> known(total, 0);
+	int safeLeft = total - puzzle.mines;
+	mt19937 rng(candidate.seed);
+	candidate.bbbv = countBBBV(puzzle);
+	candidate.guesses = 0;
+	candidate.survival = 1;
+	
+	while (!deduceCells(puzzle, known, safeLeft, 2)) {
+		ConstraintModel model = buildPuzzleModel(puzzle, known);
+		vector<double> probability;
+		double interiorProbability = 0;
+		vector<double> cellProbability(total, -1);
+		int unknown = 0;
+		
+		for (int cell = 0; cell < total; ++cell) {
+			unknown += known[cell] == 0;
+		}
+		
+		// 精确枚举超出节点上限时，近似认为所有未知格子的概率相同
+		if (solveExactProbabilities(model, probability, interiorProbability, nullptr, nullptr, PUZZLE_NODE_LIMIT)) {
+			for (int cell = 0; cell < total; ++cell) {
+				if (known[cell] == 0) cellProbability[cell] = interiorProbability;
+			}
+			
+			for (size_t v = 0; v < model.cells.size(); ++v) {
+				cellProbability[model.cells[v]] = probability[v];
+			}
+		} else {
+			for (int cell = 0; cell < total; ++cell) {
+				if (known[cell] == 0) cellProbability[cell] = (double)model.minesLeft / unknown;
+			}
+		}
+		
+		double lowest = 1;
+		
+		for (int cell = 0; cell < total; ++cell) {
+			if (known[cell] == 0) lowest = min(lowest, cellProbability[cell]);
+		}
+		
+		// 在概率最小的格子中随机猜一个实际安全的；都是地雷时（玩家会在这里失败）改猜概率最小的安全格子继续评估
+		vector<int> choices;
+		
+		for (int cell = 0; cell < total; ++cell) {
+			if (known[cell] == 0 && puzzle.cells[cell] != 'M' && cellProbability[cell] <= lowest + 1e-9) {
+				choices.push_back(cell);
+			}
+		}
+		
+		if (choices.empty()) {
+			int best = -1;
+			
+			for (int cell = 0; cell < total; ++cell) {
+				if (known[cell] == 0 && puzzle.cells[cell] != 'M' && (best < 0 || cellProbability[cell] < cellProbability[best])) {
+					best = cell;
+				}
+			}
+			
+			choices.push_back(best);
+		}
+		
+		known[choices[rng() % choices.size()]] = 1;
+		safeLeft--;
+		candidate.guesses++;
+		candidate.survival *= 1 - lowest;
+	}
+	
+	double seconds = candidate.bbbv / BBBV_PER_SECOND + candidate.guesses * GUESS_SECONDS;
+	candidate.expectedSeconds = seconds / max(candidate.survival, 0.01);
+}
+
+// 目标难度曲线：第 level 层的预计用时
+double ladderTargetSeconds(int level) {
+	return LADDER_BASE_SECONDS * pow(LADDER_GROWTH, level - 1);
+}
+
+// 开始为下一层准备候选棋盘：在当前棋盘大小附近随机选取大小和地雷密度，交给线程池生成并评估，不阻塞玩家
+void planLadderCandidates() {
+	if (!ladderPool) {
+		ladderPool.reset(new ThreadPool(max(1u, thread::hardware_concurrency())));
+	}
+	
+	int planId;
+	
+	{
+		lock_guard<mutex> lock(ladderPlanMutex);
+		planId = ++ladderPlanId;
+		ladderCandidates.clear();
+	}
+	
+	mt19937 rng(random_device{}());
+	int maxSize = min(LADDER_MAX_SIZE, max(rows, cols) + 4);
+	int minSize = min(max(LADDER_MIN_SIZE, rows - 2), maxSize); // 当前棋盘已超过上限时只在上限处取值
+	
+	for (int k = 0; k < LADDER_CANDIDATES; ++k) {
+		int size = minSize + rng() % (maxSize - minSize + 1);
+		double density = LADDER_MIN_DENSITY + (LADDER_MAX_DENSITY - LADDER_MIN_DENSITY) * (rng() % 1000) / 1000.0;
+		int candidateMines = max(1, min(size * size - 1, (int)round(density * size * size)));
+		unsigned seed = rng();
+		
+		ladderPool->submit([planId, size, candidateMines, seed] {
+			{
+				lock_guard<mutex> lock(ladderPlanMutex);
+				
+				if (planId != ladderPlanId) return; // 玩家已经离开这一层，候选作废
+			}
+			
+			LevelCandidate candidate;
+			candidate.seed = seed;
+			mt19937 boardRng(seed);
+			generatePuzzleBoard(candidate.puzzle, size, size, candidateMines, boardRng);
+			scoreLadderCandidate(candidate);
+			lock_guard<mutex> lock(ladderPlanMutex);
+			
+			if (planId == ladderPlanId) {
+				ladderCandidates.push_back(move(candidate));
 			}
+		});
+	}
+}
+
+// 取出第 level 层的棋盘：在已评估完的候选中选择预计用时与目标曲线之比最接近 1 的。
+// 一个候选都还没有评估完时返回 false，由调用者按原来的规则加大难度，不等待
+bool takeLadderLevel(int level, LevelCandidate &chosen) {
+	lock_guard<mutex> lock(ladderPlanMutex);
+	
+	if (ladderCandidates.empty()) return false;
+	
+	double target = ladderTargetSeconds(level);
+	size_t best = 0;
+	
+	for (size_t k = 1; k < ladderCandidates.size(); ++k) {
+		if (fabs(log(ladderCandidates[k].expectedSeconds / target)) < fabs(log(ladderCandidates[best].expectedSeconds / target))) {
+			best = k;
+		}
+	}
+	
+	chosen = move(ladderCandidates[best]);
+	ladderCandidates.clear();
+	ladderPlanId++; // 其余还在评估的候选作废
+	return true;
+}
+
+// 把选中的候选棋盘放到当前棋盘上，并在棋盘下方显示它的难度评估
+void loadLadderCandidate(const LevelCandidate &candidate) {
+	for (int cell = 0; cell < rows * cols; ++cell) {
+		board[cell / cols][cell % cols] = candidate.puzzle.cells[cell];
+	}
+	
+	indexMines();
+	boardSeed = candidate.seed;
+	ostringstream text;
+	text << "第 " << currentLevel << " 层：3BV " << candidate.bbbv << "，需要猜测 " << candidate.guesses << " 次，预计用时 " << fixed << setprecision(1) << candidate.expectedSeconds << " 秒";
+	statusMessage = text.str();
+}
+
+// 停止天梯候选评估的线程池，正在评估的棋盘会先完成
+void stopLadderPlanner() {
+	{
+		lock_guard<mutex> lock(ladderPlanMutex);
+		ladderPlanId++;
+	}
+	
+	ladderPool.reset();
+}
+
+// 开始一局的计时：记录开局时间和开局时棋盘的 3BV，清空走子时间线
+void startGameClock() {
+	startTime = chrono::steady_clock::now();
+	gameStartedAt = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	PuzzleBoard puzzle;
+	puzzle.rows = rows;
+	puzzle.cols = cols;
+	puzzle.mines = mines;
+	puzzle.cells.resize(rows * cols);
+	puzzle.revealed.resize(rows * cols);
+	
+	for (int cell = 0; cell < rows * cols; ++cell) {
+		puzzle.cells[cell] = board[cell / cols][cell % cols];
+		puzzle.revealed[cell] = revealed[cell / cols][cell % cols];
+	}
+	
+	gameBBBV = countBBBV(puzzle);
+	moveTimeline.clear();
+	chunkedMoves = 0;
+	moveFilePath = username + "_moves.bin";
+	inputReady = false;
+	renderPending = false;
+	timedMoveOpen = false;
+}
+
+// 开始等待输入：上一步的渲染到此结束，下一步的思考从此开始
+void markInputReady() {
+	auto now = chrono::steady_clock::now();
+	
+	if (renderPending && !moveTimeline.empty()) {
+		moveTimeline.back().renderMs += chrono::duration<float, milli>(now - renderStartTime).count();
+	}
+	
+	renderPending = false;
+	inputReadyTime = now;
+	inputReady = true;
+}
+
+// 开始执行一步操作。同一批命令中只有第一条操作有思考时间
+void beginTimedMove(char action, int x, int y) {
+	auto now = chrono::steady_clock::now();
+	MoveTiming move;
+	move.action = action;
+	move.x = x;
+	move.y = y;
+	move.atMs = chrono::duration_cast<chrono::milliseconds>(now - startTime).count();
+	move.thinkMs = inputReady ? chrono::duration<float, milli>(now - inputReadyTime).count() : 0;
+	move.engineMs = 0;
+	move.renderMs = 0;
+	
+	if (moveTimeline.size() == MOVE_TIMELINE_CHUNK) {
+		flushMoveChunk(); // 上一步的渲染耗时已经在 markInputReady 中计入
+	}
+	
+	moveTimeline.push_back(move);
+	inputReady = false;
+	renderPending = false;
+	timedMoveOpen = true;
+	moveStartTime = now;
+}
+
+// 一步操作执行完毕，开始计算它的渲染耗时。踩雷时在显示结算画面之前调用，之后的调用不再起作用
+void endTimedMove() {
+	if (!timedMoveOpen) return;
+	
+	auto now = chrono::steady_clock::now();
+	moveTimeline.back().engineMs = chrono::duration<float, milli>(now - moveStartTime).count();
+	timedMoveOpen = false;
+	renderStartTime = now;
+	renderPending = true;
+}
+
+// 把缓冲的走子时间线的一个字段作为一列写出
+template<typename T, typename Field>
+void writeMoveColumn(ostream &out, Field field) {
+	T *column = (T *)moveColumnBuffer.data();
+	
+	for (size_t k = 0; k < moveTimeline.size(); ++k) {
+		column[k] = field(moveTimeline[k]);
+	}
+	
+	out.write((const char *)column, moveTimeline.size() * sizeof(T));
+}
+
+// 把缓冲的走子时间线按列写出
+void writeMoveColumns(ostream &out) {
+	writeMoveColumn<uint8_t>(out, [](const MoveTiming &move) {
+		return (uint8_t)move.action;
+	});
+	writeMoveColumn<int16_t>(out, [](const MoveTiming &move) {
+		return move.x;
+	});
+	writeMoveColumn<int16_t>(out, [](const MoveTiming &move) {
+		return move.y;
+	});
+	writeMoveColumn<uint32_t>(out, [](const MoveTiming &move) {
+		return move.atMs;
+	});
+	writeMoveColumn<float>(out, [](const MoveTiming &move) {
+		return move.thinkMs;
+	});
+	writeMoveColumn<float>(out, [](const MoveTiming &move) {
+		return move.engineMs;
+	});
+	writeMoveColumn<float>(out, [](const MoveTiming &move) {
+		return move.renderMs;
+	});
+}
+
+// 缓冲区写满时把它作为一个分块追加到文件并清空，走子中途不再扩容
+void flushMoveChunk() {
+	ofstream file;
+	file.rdbuf()->pubsetbuf(moveChunkStreamBuffer, sizeof(moveChunkStreamBuffer));
+	file.open(moveFilePath, ios::binary | ios::app);
+	
+	if (file.is_open()) {
+		MoveChunkHeader chunk;
+		memcpy(chunk.magic, MOVE_CHUNK_MAGIC, sizeof(chunk.magic));
+		chunk.moves = moveTimeline.size();
+		chunk.startedAt = gameStartedAt;
+		file.write((const char *)&chunk, sizeof(chunk));
+		writeMoveColumns(file);
+	}
+	
+	chunkedMoves += moveTimeline.size(); // 写入失败时这些步数也照常计入，分析时会因分块对不上而跳过
+	moveTimeline.clear();
+}
+
+// 一局结束时把剩余的走子时间线按列追加到 <用户名>_moves.bin
+void saveMoveTimeline(bool win, int level, double duration) {
+	endTimedMove();
+	markInputReady(); // 结算画面算作最后一步的渲染
+	inputReady = false;
+	
+	if (moveTimeline.empty() && chunkedMoves == 0) return;
+	
+	ofstream file(moveFilePath, ios::binary | ios::app);
+	
+	if (!file.is_open()) {
+		cout << "无法保存走子时间线。" << endl;
+		return;
+	}
+	
+	MoveTimelineHeader header = {};
+	memcpy(header.magic, MOVE_FILE_MAGIC, sizeof(header.magic));
+	header.moves = chunkedMoves + moveTimeline.size();
+	header.startedAt = gameStartedAt;
+	header.durationMs = llround(duration * 1000);
+	header.bbbv = gameBBBV;
+	header.rows = rows;
+	header.cols = cols;
+	header.mines = mines;
+	header.leftClicks = leftClickCount;
+	header.rightClicks = rightClickCount;
+	header.level = gameMode == "天梯模式" ? level : 0;
+	header.mode = gameMode == "残局模式" ? 1 : gameMode == "天梯模式" ? 2 : 0;
+	header.win = win;
+	header.chunkedMoves = chunkedMoves;
+	file.write((const char *)&header, sizeof(header));
+	writeMoveColumns(file);
+	moveTimeline.clear();
+	chunkedMoves = 0;
+}
+
+// 对数分桶直方图：内存占用固定，可以流式累加任意多个非负值并估计分位数（相对误差约 2.3%）
+struct LogHistogram {
+	vector<long long> counts = vector<long long>(HISTOGRAM_BUCKETS_PER_DECADE * HISTOGRAM_DECADES + 2, 0);
+	long long total = 0;
+	double sum = 0, maxValue = 0;
+	
+	void add(double value) {
+		int bucket = 0;
+		
+		if (value >= HISTOGRAM_MIN) {
+			bucket = 1 + (int)(log10(value / HISTOGRAM_MIN) * HISTOGRAM_BUCKETS_PER_DECADE);
+			bucket = min(bucket, (int)counts.size() - 1);
+		}
+		
+		counts[bucket]++;
+		total++;
+		sum += value;
+		maxValue = max(maxValue, value);
+	}
+	
+	void merge(const LogHistogram &other) {
+		for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+			counts[bucket] += other.counts[bucket];
+		}
+		
+		total += other.total;
+		sum += other.sum;
+		maxValue = max(maxValue, other.maxValue);
+	}
+	
+	// 第 q 分位数：取所在分桶上下界的几何平均，不超过实际最大值
+	double quantile(double q) const {
+		long long rank = max(1LL, (long long)ceil(q * total));
+		long long seen = 0;
+		
+		for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+			seen += counts[bucket];
+			
+			if (seen < rank) continue;
+			
+			if (bucket == 0) return 0;
 			
-			if (action == 'l') {
-				leftClick(x, y); // 左键点击
-			} else if (action == 'r') {
-				rightClick(x, y); // 右键点击
+			if (bucket == counts.size() - 1) return maxValue;
+			
+			return min(maxValue, HISTOGRAM_MIN * pow(10, (bucket - 0.5) / HISTOGRAM_BUCKETS_PER_DECADE));
+		}
+		
+		return maxValue;
+	}
+};
+
+// 一个用户的走子分析结果
+struct MoveAnalysis {
+	long long games = 0, wins = 0, moves = 0;
+	LogHistogram think, engine, render; // 每步耗时（毫秒）
+	LogHistogram bbbvPerSecond, clicksPerBBBV; // 每局胜局的效率
+	long long winBBBV = 0, winClicks = 0;
+	double winSeconds = 0;
+};
+
+// 读取一局或一个分块的各列，只读取相邻的三列耗时，跳过其余各列
+bool readMoveTimings(istream &file, uint32_t moves, vector<float> &column, MoveAnalysis &analysis) {
+	file.seekg((streamoff)moves * (sizeof(uint8_t) + 2 * sizeof(int16_t) + sizeof(uint32_t)), ios::cur); // 操作、行、列和时刻
+	column.resize(3 * (size_t)moves);
+	
+	if (!file.read((char *)column.data(), column.size() * sizeof(float))) return false;
+	
+	for (uint32_t k = 0; k < moves; ++k) {
+		analysis.think.add(column[k]);
+		analysis.engine.add(column[moves + k]);
+		analysis.render.add(column[2 * (size_t)moves + k]);
+	}
+	
+	analysis.moves += moves;
+	return true;
+}
+
+// 逐局流式读取走子时间线文件并累加到 analysis。一局之前的分块先单独累计，读到这一局的文件头时
+// 开局时间和步数都对得上才计入，中途退出的对局留下的分块被丢弃。
+// 文件不存在时返回 true；文件末尾不完整或格式错误时返回 false，此前读到的完整对局仍然计入
+bool accumulateMoveAnalysis(const string &path, MoveAnalysis &analysis) {
+	ifstream file(path, ios::binary);
+	
+	if (!file.is_open()) return true;
+	
+	MoveTimelineHeader header;
+	MoveChunkHeader chunk;
+	MoveAnalysis pending; // 还没有读到所属对局的分块
+	int64_t pendingStartedAt = 0;
+	vector<float> column;
+	
+	while (file.read(header.magic, sizeof(header.magic))) {
+		if (memcmp(header.magic, MOVE_CHUNK_MAGIC, sizeof(header.magic)) == 0) {
+			if (!file.read((char *)&chunk + sizeof(chunk.magic), sizeof(chunk) - sizeof(chunk.magic))) return false;
+			
+			if (pending.moves > 0 && chunk.startedAt != pendingStartedAt) {
+				pending = MoveAnalysis(); // 上一局中途退出，没有写入对局文件头
 			}
+			
+			pendingStartedAt = chunk.startedAt;
+			
+			if (!readMoveTimings(file, chunk.moves, column, pending)) return false;
+			
+			continue;
+		}
+		
+		if (memcmp(header.magic, MOVE_FILE_MAGIC, sizeof(header.magic)) != 0) return false;
+		
+		if (!file.read((char *)&header + sizeof(header.magic), sizeof(header) - sizeof(header.magic)) || header.chunkedMoves > header.moves) return false;
+		
+		if (pending.moves == header.chunkedMoves && (pending.moves == 0 || pendingStartedAt == header.startedAt)) {
+			analysis.think.merge(pending.think);
+			analysis.engine.merge(pending.engine);
+			analysis.render.merge(pending.render);
+			analysis.moves += pending.moves;
+		}
+		
+		pending = MoveAnalysis();
+		
+		if (!readMoveTimings(file, header.moves - header.chunkedMoves, column, analysis)) return false;
+		
+		analysis.games++;
+		
+		if (!header.win || header.bbbv == 0) continue;
+		
+		double seconds = max(header.durationMs, 1u) / 1000.0;
+		long long clicks = (long long)header.leftClicks + header.rightClicks;
+		analysis.wins++;
+		analysis.bbbvPerSecond.add(header.bbbv / seconds);
+		analysis.clicksPerBBBV.add((double)clicks / header.bbbv);
+		analysis.winBBBV += header.bbbv;
+		analysis.winClicks += clicks;
+		analysis.winSeconds += seconds;
+	}
+	
+	return file.eof() && file.gcount() == 0;
+}
+
+// 显示一个用户的走子分析：每步思考、引擎和渲染耗时的分位数，以及胜局的效率
+void printMoveAnalysis(const string &user, const MoveAnalysis &analysis) {
+	cout << YELLOW << "【" << user << "】" << RESET << " 共 " << analysis.games << " 局（胜利 " << analysis.wins << " 局），" << analysis.moves << " 步" << endl;
+	cout << fixed << setprecision(3);
+	const pair<const char *, const LogHistogram *> timings[] = {
+		{"思考", &analysis.think}, {"引擎", &analysis.engine}, {"渲染", &analysis.render}
+	};
+	
+	for (const auto &timing : timings) {
+		const LogHistogram &histogram = *timing.second;
+		
+		if (histogram.total == 0) continue;
+		
+		cout << timing.first << "耗时（毫秒）: 平均 " << histogram.sum / histogram.total << "，p50 " << histogram.quantile(0.5)
+		     << "，p90 " << histogram.quantile(0.9) << "，p99 " << histogram.quantile(0.99) << "，最大 " << histogram.maxValue << endl;
+	}
+	
+	if (analysis.wins > 0) {
+		cout << setprecision(2) << "胜局 3BV/s: 总体 " << analysis.winBBBV / analysis.winSeconds << "，p50 " << analysis.bbbvPerSecond.quantile(0.5)
+		     << "，p90 " << analysis.bbbvPerSecond.quantile(0.9) << "，最好 " << analysis.bbbvPerSecond.maxValue << endl;
+		cout << "胜局每 3BV 点击数: 总体 " << (double)analysis.winClicks / analysis.winBBBV << "，p10 " << analysis.clicksPerBBBV.quantile(0.1)
+		     << "，p50 " << analysis.clicksPerBBBV.quantile(0.5) << "，p90 " << analysis.clicksPerBBBV.quantile(0.9) << endl;
+	}
+	
+	cout << defaultfloat << setprecision(6);
+}
+
+// 菜单中的走子分析：分析当前用户的走子时间线
+void showMoveAnalysis() {
+	clearScreen();
+	MoveAnalysis analysis;
+	
+	if (!accumulateMoveAnalysis(username + "_moves.bin", analysis)) {
+		cout << "走子时间线文件不完整，只统计了前 " << analysis.games << " 局。" << endl;
+	}
+	
+	if (analysis.games == 0) {
+		cout << "没有走子记录。" << endl;
+	} else {
+		printMoveAnalysis(username, analysis);
+	}
+	
+	char choice;
+	
+	while (true) {
+		cout << "输入 'm' 返回菜单: ";
+		cin >> choice;
+		
+		if (cin.fail()) {
+			handleInvalidInput();
+			continue;
+		}
+		
+		if (choice == 'm') {
+			clearScreen();
+			showMenu();
+			break;
 		} else {
 			clearScreen();
-			cout << "无效操作，请重新输入。" << endl;
+			cout << "无效选择。请重新输入。" << endl;
+		}
+	}
+}
+
+// 批量分析多个用户的走子时间线：--analyze <用户名> [<用户名> ...]
+int analyzeMoveTimelines(int argc, char *argv[]) {
+	if (argc < 3) {
+		cout << "用法: " << argv[0] << " --analyze <用户名> [<用户名> ...]" << endl;
+		return 1;
+	}
+	
+	int status = 0;
+	
+	for (int i = 2; i < argc; ++i) {
+		string user = argv[i];
+		MoveAnalysis analysis;
+		
+		if (!accumulateMoveAnalysis(user + "_moves.bin", analysis)) {
+			cout << user << "_moves.bin 不完整，只统计了前 " << analysis.games << " 局。" << endl;
+			status = 1;
+		}
+		
+		printMoveAnalysis(user, analysis);
+	}
+	
+	return status;
+}
+
+// 当前游戏是否可以使用概率提示（天梯模式中提示需要通过道具获得）
+bool hintActive() {
+	return gameMode != "天梯模式";
+}
+
+// 概率提示：估计各格子的地雷概率，把光标移到最安全的未标记格子并显示其概率。给出提示时由 gameSeconds 加上用时惩罚
+void showProbabilityHint() {
+	ProbabilityEstimate estimate = estimateMineProbabilities(buildConstraintModel(), PROBABILITY_TIME_BUDGET_MS);
+	int best = -1;
+	
+	for (int k = 0; k < rows * cols; ++k) {
+		const CellProbability &cell = estimate.cells[k];
+		
+		if (cell.p < 0 || flagged[k / cols][k % cols]) continue;
+		
+		if (best < 0 || cell.p < estimate.cells[best].p || (cell.p == estimate.cells[best].p && cell.high < estimate.cells[best].high)) {
+			best = k;
+		}
+	}
+	
+	if (best < 0) {
+		statusMessage = "没有可以提示的格子。";
+		return;
+	}
+	
+	hintCount++;
+	const CellProbability &cell = estimate.cells[best];
+	char text[160];
+	snprintf(text, sizeof(text), "最安全的格子: (%d, %d)，地雷概率 %.1f%% [%.1f%%, %.1f%%]，%lld 个样本，%d 线程，%lld 毫秒",
+	         best / cols, best % cols, cell.p * 100, cell.low * 100, cell.high * 100, estimate.samples, estimate.threads, estimate.elapsedMs);
+	statusMessage = YELLOW + text + RESET;
+	
+	// 光标移到提示的格子
+	markDirty(cursorX, cursorY);
+	cursorX = best / cols;
+	cursorY = best % cols;
+	screenDirty = true;
+}
+
+// 经典和残局模式
+void classicAndResidualMode() {
+	initializeGame();
+	setupBoard();
+	startGameClock();
+	
+	while (true) {
+#ifdef COUNT_ALLOCATIONS
+		long long allocationsBefore = allocationCount;
+		int generationBefore = gameGeneration;
+#endif
+		
+		if (interactiveInput) {
+			int x = -1, y = -1;
+			char action = waitForAction(x, y, false);
+			applyAction(action, x, y);
+		} else {
+			if (!quietMode && !inputPending()) {
+				showCommandPrompt(false);
+			}
+			
+			markInputReady();
+			
+			if (!getline(cin, commandLine)) {
+				handleInvalidInput();
+				continue;
+			}
+			
+			CommandReader reader = {commandLine.data(), commandLine.data() + commandLine.size()};
+			
+			if (!runCommandBatch(reader, false, 0)) {
+				clearScreen();
+				cout << "无效操作，请重新输入。" << endl;
+			}
+			
+			dirtyCells.clear(); // 命令模式总是整屏渲染，不需要局部重绘的记录
 		}
 		
+#ifdef COUNT_ALLOCATIONS
+		countMoveAllocations(allocationsBefore, generationBefore);
+#endif
+		
 		if (checkWin()) {
 			// 询问是否重新开始或返回菜单
 			char choice;
@@ -848,15 +5173,19 @@ void classicAndResidualMode() {
 				cout << "游戏结束。输入 'm' 返回菜单，或输入 's' 重新开始: ";
 				cin >> choice;
 				
+				if (cin.fail()) {
+					handleInvalidInput();
+					continue;
+				}
+				
 				if (choice == 'm') {
 					showMenu();
 					break;
 				} else if (choice == 's') {
 					clearScreen();
 					startOptionsInterface();
-					placeMines();
-					calculateNumbers();
-					startTime = chrono::steady_clock::now();
+					setupBoard();
+					startGameClock();
 					break;
 				} else {
 					clearScreen();
@@ -867,50 +5196,87 @@ void classicAndResidualMode() {
 	}
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+	if (argc >= 2 && string(argv[1]) == "--generate-residual") {
+		return generateResidualPool(argc, argv); // 离线生成残局库
+	}
+	
+	if (argc >= 2 && string(argv[1]) == "--write-corpus") {
+		return writeBoardCorpus(argc, argv); // 生成棋盘语料库
+	}
+	
+	if (argc >= 2 && string(argv[1]) == "--analyze") {
+		return analyzeMoveTimelines(argc, argv); // 分析走子时间线
+	}
+	
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		
+		if (arg == "--quiet") {
+			quietMode = true; // 静默模式：只执行命令，不渲染棋盘
+		} else if (arg == "--undo") {
+			allowUndo = true; // 经典和残局模式下允许悔棋
+		} else if (arg == "--board" && i + 1 < argc) {
+			boardFile = argv[++i]; // 经典和残局模式从棋盘文件开局
+		} else if (arg == "--board-index" && i + 1 < argc) {
+			boardFileIndex = max(atoi(argv[++i]), 0);
+		} else {
+			cout << "未知参数: " << arg << endl;
+			cout << "用法: " << argv[0] << " [--quiet] [--undo] [--board <文件> [--board-index <序号>]]" << endl;
+			cout << "      " << argv[0] << " --generate-residual <文件> <数量> [行x列x地雷 ...]" << endl;
+			cout << "      " << argv[0] << " --write-corpus <文件> <数量> <行x列x地雷> [--rle]" << endl;
+			cout << "      " << argv[0] << " --analyze <用户名> [<用户名> ...]" << endl;
+			return 1;
+		}
+	}
+	
+	ios::sync_with_stdio(false); // 使用独立的输入缓冲区，以便判断是否还有待处理的命令
+	interactiveInput = isatty(STDIN_FILENO) && !quietMode; // 终端输入时启用按键事件循环
+	srand(time(0)); // 从缓存取出棋盘时不会调用 placeMines，这里先初始化随机数
+	commandLine.reserve(COMMAND_LINE_RESERVE);
+	startBoardCache(); // 打开棋盘缓存并启动后台补充线程
 	login(); // 登录
 	showMenu(); // 显示菜单
 	
 	while (true) {
-		clearScreen(); // 清除屏幕
-		printBoard(); // 打印棋盘
-		char action;
-		cout << "输入操作 (l 为左键点击, r 为右键点击";
-		
-		if (gameMode == "天梯模式") {
-			cout << ", t 为使用道具";
-		}
-		
-		cout << "): ";
-		string input;
-		getline(cin, input);
-		istringstream iss(input);
-		iss >> action;
+		bool allowItem = gameMode == "天梯模式";
+#ifdef COUNT_ALLOCATIONS
+		long long allocationsBefore = allocationCount;
+		int generationBefore = gameGeneration;
+#endif
 		
-		if (action == 'l' || action == 'r' || (action == 't' && gameMode == "天梯模式")) {
-			int x, y;
+		if (interactiveInput) {
+			// 终端输入：按键事件循环，只局部重绘变化的格子和计时器
+			int x = -1, y = -1;
+			char action = waitForAction(x, y, allowItem);
+			applyAction(action, x, y);
+		} else {
+			// 批量命令：缓冲区中的命令全部执行完后才渲染一次
+			if (!quietMode && !inputPending()) {
+				showCommandPrompt(allowItem);
+			}
 			
-			if (action == 'l' || action == 'r') {
-				iss >> x >> y;
-				
-				if (iss.fail()) {
-					handleInvalidInput();
-					continue;
-				}
-				
-				if (action == 'l') {
-					leftClick(x, y); // 左键点击
-				} else if (action == 'r') {
-					rightClick(x, y); // 右键点击
-				}
-			} else if (action == 't') {
-				useItem(); // 使用道具
+			markInputReady();
+			
+			if (!getline(cin, commandLine)) {
+				handleInvalidInput();
+				continue;
 			}
-		} else {
-			clearScreen();
-			cout << "无效操作，请重新输入。" << endl;
+			
+			CommandReader reader = {commandLine.data(), commandLine.data() + commandLine.size()};
+			
+			if (!runCommandBatch(reader, allowItem, 0)) {
+				clearScreen();
+				cout << "无效操作，请重新输入。" << endl;
+			}
+			
+			dirtyCells.clear(); // 命令模式总是整屏渲染，不需要局部重绘的记录
 		}
 		
+#ifdef COUNT_ALLOCATIONS
+		countMoveAllocations(allocationsBefore, generationBefore);
+#endif
+		
 		if (checkWin()) {
 			// 询问是否重新开始或返回菜单
 			char choice;
@@ -919,15 +5285,19 @@ int main() {
 				cout << "游戏结束。输入 'm' 返回菜单，或输入 's' 重新开始: ";
 				cin >> choice;
 				
+				if (cin.fail()) {
+					handleInvalidInput();
+					continue;
+				}
+				
 				if (choice == 'm') {
 					showMenu();
 					break;
 				} else if (choice == 's') {
 					clearScreen();
 					startOptionsInterface();
-					placeMines();
-					calculateNumbers();
-					startTime = chrono::steady_clock::now();
+					setupBoard();
+					startGameClock();
 					break;
 				} else {
 					clearScreen();